@@ -0,0 +1,139 @@
+#ifndef LIBRESPONSE_BENCH_SYNTHETIC_H_
+#define LIBRESPONSE_BENCH_SYNTHETIC_H_
+
+/*!
+ * @file
+ *
+ * Synthetic J/K engine and reference wavefunctions for benchmarking
+ * the solvers without a host program.
+ */
+
+#include <armadillo>
+#include <vector>
+#include "../matvec_factored.h"
+#include "../operator_spec.h"
+
+namespace libresponse {
+namespace bench {
+
+/*!
+ * Random factored integrals \f$ B_{\mu\nu}^{Q} \f$, symmetric in
+ * \f$ \mu\nu \f$, so the 4-index integrals formed from them have
+ * the permutational symmetry and positive semidefiniteness of real
+ * ERIs.
+ *
+ * @param[in] nbasis number of basis functions
+ * @param[in] naux number of auxiliary functions
+ * @param[in] scale size of the largest element
+ */
+arma::cube make_factored_integrals(size_t nbasis, size_t naux, double scale);
+
+/*!
+ * J/K engine over synthetic factored integrals, with a tunable cost.
+ *
+ * Each call is answered by MatVec_factored, then repeated
+ * (n_repeat - 1) more times, so the cost of a Fock build relative to
+ * the rest of the solver can be made to look like a real engine.
+ * The number of calls and densities is counted so solvers can be
+ * compared by Fock builds as well as by time.
+ */
+class MatVec_synthetic : public MatVec_i {
+
+public:
+
+    /*!
+     * @param[in] nbasis number of basis functions
+     * @param[in] naux number of auxiliary functions
+     * @param[in] n_repeat_ number of times each build is done, at least 1
+     */
+    MatVec_synthetic(size_t nbasis, size_t naux, size_t n_repeat_);
+    ~MatVec_synthetic();
+
+    void compute(arma::cube &J, arma::cube &K, arma::cube &P);
+    void compute(arma::cube &J, arma::cube &K, const std::vector<arma::mat> &L, const std::vector<arma::mat> &R);
+    bool prefers_factored_densities() const;
+
+    size_t n_calls;     //!< number of calls to compute
+    size_t n_densities; //!< total number of densities over all calls
+
+private:
+
+    // Declared (and so constructed) before the engine that points
+    // to them.
+    arma::cube B;
+    MatVec_factored engine;
+    size_t n_repeat;
+
+};
+
+/*!
+ * An orthonormal-MO reference for the orthogonal solvers, in an
+ * orthonormal AO basis: random orthogonal C and MO energies with a
+ * HOMO-LUMO gap, for solve_linear_response(..., moene, ...).
+ *
+ * @param[out] &C MO coefficients, [nbasis, nbasis, nden]
+ * @param[out] &moene MO energies, [nbasis, nden]
+ * @param[out] &occupations nocc_alph, nvirt_alph, nocc_beta, nvirt_beta
+ * @param[in] nbasis number of basis functions (and MOs)
+ * @param[in] nocc number of occupied MOs per spin
+ * @param[in] nden 1 for restricted, 2 for unrestricted
+ */
+void make_orthogonal_reference(
+    arma::cube &C,
+    arma::mat &moene,
+    arma::uvec &occupations,
+    size_t nbasis,
+    size_t nocc,
+    size_t nden
+    );
+
+/*!
+ * A fragment-localized (ALMO-like) reference for the nonorthogonal
+ * solvers: each fragment's MOs only have AO coefficients on that
+ * fragment, the AO overlap couples neighbouring fragments, and the
+ * AO Fock matrix is formed so the MO-basis Fock matrix is close to
+ * diagonal.
+ *
+ * The MOs are ordered as the occupied MOs of every fragment, then
+ * the virtual MOs of every fragment.
+ *
+ * @param[out] &C MO coefficients, [nbasis, nbasis, nden]
+ * @param[out] &F AO Fock matrices, [nbasis, nbasis, nden]
+ * @param[out] &S AO overlap matrix
+ * @param[out] &fragment_occupations one row per fragment: nbasis, norb, nocc_alph, nocc_beta
+ * @param[out] &occupations nocc_alph, nvirt_alph, nocc_beta, nvirt_beta
+ * @param[in] nbasis_frgm number of basis functions (and MOs) per fragment
+ * @param[in] nocc_frgm number of occupied MOs per fragment and spin
+ * @param[in] n_frgm number of fragments
+ * @param[in] nden 1 for restricted, 2 for unrestricted
+ */
+void make_fragment_reference(
+    arma::cube &C,
+    arma::cube &F,
+    arma::mat &S,
+    arma::umat &fragment_occupations,
+    arma::uvec &occupations,
+    size_t nbasis_frgm,
+    size_t nocc_frgm,
+    size_t n_frgm,
+    size_t nden
+    );
+
+/*!
+ * Dipole-like operators with random symmetric integrals; each
+ * operator has 3 components.
+ *
+ * @param[out] &operators appended to
+ * @param[in] nbasis number of basis functions
+ * @param[in] n_operators number of operators to make
+ */
+void make_operators(
+    std::vector<operator_spec> &operators,
+    size_t nbasis,
+    size_t n_operators
+    );
+
+} // namespace bench
+} // namespace libresponse
+
+#endif // LIBRESPONSE_BENCH_SYNTHETIC_H_
@@ -0,0 +1,161 @@
+#ifndef LIBRESPONSE_CHECKPOINT_H_
+#define LIBRESPONSE_CHECKPOINT_H_
+
+/*!
+ * @file
+ *
+ * Single-file binary checkpoints that can be memory-mapped on read.
+ *
+ * The layout is a short header, the raw column-major data for each
+ * entry (8-byte aligned), a table of contents, and a footer that
+ * points to the table of contents:
+ *
+ *     "LRSPCHK1"
+ *     data for entry 0, entry 1, ...
+ *     for each entry: name length, name (padded to 8 bytes),
+ *                     n_rows, n_cols, n_slices, offset of data
+ *     number of entries, offset of table of contents, "LRSPCHK1"
+ *
+ * All integers are stored as 64-bit unsigned values in native byte
+ * order. Since each column of a matrix is contiguous, individual
+ * operator components can be read without touching the rest of the
+ * file.
+ */
+
+#include <armadillo>
+#include <fstream>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace libresponse {
+
+/*!
+ * Metadata for a single named entry in a checkpoint file.
+ */
+struct checkpoint_entry {
+    uint64_t n_rows;
+    uint64_t n_cols;
+    uint64_t n_slices;
+    uint64_t offset; //!< byte offset of the data from the start of the file
+};
+
+/*!
+ * Write named Armadillo containers to a single binary checkpoint file.
+ *
+ * The data is written to a temporary file which replaces the target
+ * only when close() succeeds, so an interrupted write never leaves
+ * a truncated checkpoint behind.
+ */
+class checkpoint_writer {
+
+private:
+    std::string m_filename;
+    std::string m_tmpname;
+    std::ofstream m_stream;
+    std::vector<std::string> m_names;
+    std::vector<checkpoint_entry> m_entries;
+
+    void write_entry(const std::string &name, const double *mem, uint64_t n_rows, uint64_t n_cols, uint64_t n_slices);
+
+public:
+    /*!
+     * Open a checkpoint for writing.
+     *
+     * @param[in] &filename final name of the checkpoint file
+     */
+    checkpoint_writer(const std::string &filename);
+    ~checkpoint_writer();
+
+    void add(const std::string &name, const arma::mat &m);
+    void add(const std::string &name, const arma::cube &c);
+
+    /*!
+     * Store a single number (stored as a 1x1 entry).
+     */
+    void add_scalar(const std::string &name, double value);
+
+    /*!
+     * Write the table of contents and move the file into place.
+     */
+    void close();
+};
+
+/*!
+ * Read a checkpoint file written by checkpoint_writer through a
+ * private (copy-on-write) memory mapping.
+ *
+ * Nothing is read from disk until an entry is accessed, and pointers
+ * returned by memptr() alias the mapping directly, so they are only
+ * valid for the lifetime of the reader.
+ */
+class checkpoint_reader {
+
+private:
+    std::string m_filename;
+    void *m_map;
+    size_t m_size;
+    std::map<std::string, checkpoint_entry> m_entries;
+
+    double *data(const checkpoint_entry &e) const;
+
+    /*!
+     * Check the footer and read the table of contents, throwing if
+     * anything in it points outside the mapping.
+     */
+    void parse_toc();
+
+public:
+    /*!
+     * Map a checkpoint file and parse its table of contents.
+     *
+     * @param[in] &filename name of the checkpoint file
+     */
+    checkpoint_reader(const std::string &filename);
+    ~checkpoint_reader();
+
+    bool has(const std::string &name) const;
+
+    /*!
+     * Copy a whole entry into a matrix (or vector).
+     */
+    void load(const std::string &name, arma::mat &m) const;
+
+    /*!
+     * Copy a whole entry into a cube.
+     */
+    void load(const std::string &name, arma::cube &c) const;
+
+    /*!
+     * Read a single number written by checkpoint_writer::add_scalar.
+     */
+    double load_scalar(const std::string &name) const;
+
+    /*!
+     * Copy a single column (for response vectors, a single operator
+     * component) of an entry.
+     */
+    void load_col(const std::string &name, size_t col, arma::vec &v) const;
+
+    /*!
+     * Shape and location of an entry.
+     */
+    const checkpoint_entry &entry(const std::string &name) const;
+
+    /*!
+     * Pointer to the start of a column of an entry inside the memory
+     * map, for wrapping in a non-owning Armadillo object, for example
+     * arma::mat(ptr, n_rows, n_cols, false, true).
+     */
+    double *memptr(const std::string &name, size_t col = 0) const;
+
+private:
+    // The mapping can't be shared between copies.
+    checkpoint_reader(const checkpoint_reader &);
+    checkpoint_reader &operator=(const checkpoint_reader &);
+};
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_CHECKPOINT_H_
@@ -12,7 +12,8 @@ void dump_integrals(
     const T& arma_integrals,
     const std::string& integral_description,
     const std::string& input_basename,
-    const std::string& integral_filename_ending) {
+    const std::string& integral_filename_ending,
+    arma::file_type type = arma::arma_ascii) {
 
     const std::string integral_filename = \
         input_basename + "." + integral_filename_ending;
@@ -24,7 +25,7 @@ void dump_integrals(
         << integral_filename       \
         << std::endl;
 
-    const bool res = arma_integrals.save(integral_filename, arma::arma_ascii);
+    const bool res = arma_integrals.save(integral_filename, type);
 
     if (!res) {
         std::cout << "  Couldn't save integrals to file." << std::endl;
@@ -35,6 +36,11 @@ void dump_integrals(
 
 }
 
-void dump_ao_integrals(const std::vector<libresponse::operator_spec> &operators, const std::string &basename);
+/*!
+ * @brief Write the AO integrals of each operator to disk, as text or
+ * (if binary is true) in Armadillo's binary format, which loads
+ * much faster for large basis sets.
+ */
+void dump_ao_integrals(const std::vector<libresponse::operator_spec> &operators, const std::string &basename, bool binary = false);
 
 #endif // LIBRESPONSE_DUMP_AO_INTEGRALS_H_
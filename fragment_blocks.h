@@ -0,0 +1,108 @@
+#ifndef LIBRESPONSE_FRAGMENT_BLOCKS_H_
+#define LIBRESPONSE_FRAGMENT_BLOCKS_H_
+
+/*!
+ * @file
+ *
+ * Block-diagonal (fragment-blocked) matrices for ALMO masking.
+ */
+
+#include <vector>
+#include "typedefs.h"
+
+namespace libresponse {
+
+/*!
+ * A square matrix that only has the diagonal blocks belonging to
+ * each fragment, as given by the index sets from make_indices_ao or
+ * make_indices_mo_combined.
+ *
+ * This is the block-sparse form of make_masked_mat(mm, m, idxs):
+ * only the \f$ \sum_{F} n_{F}^{2} \f$ elements of the fragment blocks
+ * are stored, and masking, multiplication and AO2MO transformations
+ * work directly on the blocks. The blocks are allocated once in
+ * init(), so it can be reused every iteration without allocating.
+ *
+ * Index sets that are contiguous ranges (the usual case) are
+ * accessed as spans; any other sets fall back to element gathers.
+ */
+class fragment_block_mat {
+
+public:
+
+    fragment_block_mat() : m_dim(0) { }
+
+    /*!
+     * @param[in] &idxs one index set per fragment; sets must not overlap
+     */
+    explicit fragment_block_mat(const type::indices &idxs) { init(idxs); }
+
+    /*!
+     * Set the block structure and allocate the blocks.
+     *
+     * @param[in] &idxs one index set per fragment; sets must not overlap
+     */
+    void init(const type::indices &idxs);
+
+    size_t n_blocks() const { return m_blocks.size(); }
+
+    //! Smallest dimension of a full matrix holding all the blocks.
+    size_t dim() const { return m_dim; }
+
+    arma::mat &block(size_t f) { return m_blocks[f]; }
+    const arma::mat &block(size_t f) const { return m_blocks[f]; }
+    const arma::uvec &indices(size_t f) const { return m_indices[f]; }
+
+    /*!
+     * Copy the fragment blocks out of a full matrix.
+     */
+    void gather(const arma::mat &m);
+
+    /*!
+     * Write the blocks into a full matrix, zeroing everything outside
+     * them.
+     */
+    void scatter(arma::mat &m) const;
+
+    /*!
+     * Zero everything outside the fragment blocks of m, in place.
+     * Equivalent to make_masked_mat(mm, m, idxs, 0.0); m = mm, but
+     * with no full-size temporary.
+     */
+    void mask(arma::mat &m);
+
+    /*!
+     * Mask each slice of a cube in place.
+     */
+    void mask(arma::cube &c);
+
+    /*!
+     * \f$ \mathbf{Y} = \mathbf{B}\mathbf{X} \f$, one GEMM per block.
+     *
+     * @param[out] &Y [n_rows(X), n_cols(X)]
+     * @param[in] &X [dim, k] or larger
+     */
+    void multiply(arma::mat &Y, const arma::mat &X) const;
+
+    /*!
+     * AO2MO on the block-diagonal matrix,
+     * \f$ \mathbf{MO} = \sum_{F} \mathbf{C}_{F,\mathrm{from}}^{T} \mathbf{B}_{F} \mathbf{C}_{F,\mathrm{to}} \f$
+     * where \f$ \mathbf{C}_{F} \f$ are the rows of C belonging to
+     * fragment F.
+     */
+    void transform(arma::mat &MO, const arma::mat &C_from, const arma::mat &C_to) const;
+
+private:
+
+    size_t m_dim;
+    type::indices m_indices;
+    //! For contiguous index sets, the first index; otherwise unused.
+    std::vector<size_t> m_start;
+    std::vector<bool> m_contiguous;
+    std::vector<arma::mat> m_blocks;
+
+};
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_FRAGMENT_BLOCKS_H_
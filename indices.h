@@ -35,6 +35,14 @@ arma::uvec make_indices_mo_restricted(const arma::uvec &nocc_frgm, const arma::u
 
 type::indices make_indices_mo_restricted_local_occ_all_virt(const arma::uvec &nocc_frgm, const arma::uvec &nvirt_frgm);
 
+/*!
+ * The indices in [0, n) that are not in idxs, in increasing order.
+ *
+ * Zeroing v(complement) masks a vector in place, without the
+ * temporary that make_masked_mat-style masking needs.
+ */
+arma::uvec complement_indices(const arma::uvec &idxs, size_t n);
+
 // TODO is is quite general, just concatenation of of a vector of arma
 // vectors
 arma::uvec join(const type::indices &idxs);
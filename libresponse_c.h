@@ -0,0 +1,124 @@
+#ifndef LIBRESPONSE_C_H_
+#define LIBRESPONSE_C_H_
+
+/*!
+ * @file
+ *
+ * Plain C entry point to the (orthogonal) linear response solver,
+ * over the host's own buffers.
+ *
+ * All arrays are column-major. Inputs whose leading dimension and
+ * slice stride are the tight ones (ld == n_rows, stride == ld *
+ * n_cols) are used in place; anything else is packed once. Results
+ * are written straight into the caller's buffer. For ctypes and
+ * similar, every handle is an opaque pointer and every call returns 0
+ * on success or nonzero with a message in the error buffer.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Solver options: the defaults from set_defaults, changed one
+ * key/value string at a time.
+ */
+typedef struct libresponse_options libresponse_options;
+
+libresponse_options *libresponse_options_new(void);
+void libresponse_options_free(libresponse_options *options);
+
+/*!
+ * @return 0, or nonzero if the key is unknown
+ */
+int libresponse_options_set(libresponse_options *options, const char *key, const char *value);
+
+/*!
+ * J/K builds from the host: given n_densities densities P, [nbasis,
+ * nbasis, n_densities] (not necessarily symmetric), fill J and K of
+ * the same shape.
+ *
+ * n_densities is not the number of spins: each trial vector has one
+ * density per spin (alpha, then beta), and several trial vectors may
+ * be passed together (for example with solver_block), so it is nden
+ * times the number of trial vectors in this build. Each slice of J
+ * and K must only depend on the same slice of P.
+ *
+ * @return 0, or nonzero to abort the solve
+ */
+typedef int (*libresponse_jk_callback)(
+    void *user_data,
+    size_t nbasis,
+    size_t n_densities,
+    const double *P,
+    double *J,
+    double *K);
+
+/*!
+ * One operator, with its AO integrals in host memory.
+ */
+typedef struct {
+    const char *label;         //!< operator label (as in operator_metadata)
+    const char *origin_label;  //!< description of the origin
+    double origin[3];          //!< origin in bohr
+    const double *integrals;   //!< [nbasis, nbasis, ncomp] AO integrals
+    size_t ncomp;              //!< number of components
+    size_t ld;                 //!< leading dimension of integrals (>= nbasis)
+    size_t stride;             //!< distance between components (>= ld * nbasis)
+    int is_imaginary;
+    int is_spin_dependent;
+    int do_response;           //!< use as a perturbation (RHS) as well as a property
+} libresponse_operator;
+
+/*!
+ * Solve the linear response equations; see
+ * libresponse::solve_linear_response.
+ *
+ * @param[out] *results [ncomp_tot, ncomp_tot, n_omega], where
+ *             ncomp_tot is the number of components of all operators
+ * @param[in] nbasis number of AOs
+ * @param[in] norb number of MOs
+ * @param[in] nden 1 (restricted) or 2 (unrestricted)
+ * @param[in] *C MO coefficients, [nbasis, norb, nden]
+ * @param[in] ldc leading dimension of C (>= nbasis)
+ * @param[in] stride_c distance between the alpha and beta C (>= ldc * norb)
+ * @param[in] *moene MO energies, [norb, nden], tightly packed
+ * @param[in] *occupations nocc_alpha, nvirt_alpha, nocc_beta, nvirt_beta; each pair must add up to norb, with at least one occupied and one virtual MO (identical values if restricted)
+ * @param[in] *omega frequencies
+ * @param[in] n_omega number of frequencies
+ * @param[in] *operators operators
+ * @param[in] n_operators number of operators
+ * @param[in] jk J/K callback
+ * @param[in] *jk_data passed to jk
+ * @param[in] *options solver options, or NULL for the defaults
+ * @param[out] *error message on failure, may be NULL
+ * @param[in] error_len size of error
+ * @return 0 on success
+ */
+int libresponse_solve_linear(
+    double *results,
+    size_t nbasis,
+    size_t norb,
+    size_t nden,
+    const double *C,
+    size_t ldc,
+    size_t stride_c,
+    const double *moene,
+    const size_t *occupations,
+    const double *omega,
+    size_t n_omega,
+    const libresponse_operator *operators,
+    size_t n_operators,
+    libresponse_jk_callback jk,
+    void *jk_data,
+    const libresponse_options *options,
+    char *error,
+    size_t error_len);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // LIBRESPONSE_C_H_
@@ -0,0 +1,180 @@
+#ifndef LIBRESPONSE_LINEAR_EDIFF_NONORTHOGONAL_H_
+#define LIBRESPONSE_LINEAR_EDIFF_NONORTHOGONAL_H_
+
+/*!
+ * @file
+ *
+ * Matrix-free form of the one-electron ("energy difference") part of
+ * the nonorthogonal orbital Hessian.
+ */
+
+#include <armadillo>
+#include <string>
+#include "../configurable.h"
+
+namespace libresponse {
+
+/*!
+ * The one-electron terms on the LHS of the nonorthogonal response
+ * equations,
+ *
+ * \f$ E_{(ia),(jb)} = F_{ab} S_{ij} - F_{ij} S_{ab} \f$
+ *
+ * where \f$ \mathbf{F} \f$ and \f$ \mathbf{S} \f$ are the MO-basis
+ * Fock and overlap matrices. This is \f$ \mathbf{F}_{vv} \otimes
+ * \mathbf{S}_{oo} - \mathbf{S}_{vv} \otimes \mathbf{F}_{oo} \f$, so
+ * for a packed vector \f$ \mathbf{x} \f$ reshaped to a [nvirt, nocc]
+ * matrix \f$ \mathbf{X} \f$ (see repack_vector_to_matrix),
+ *
+ * \f$ \mathbf{E}\mathbf{x} = \mathbf{F}_{vv} \mathbf{X} \mathbf{S}_{oo} - \mathbf{S}_{vv} \mathbf{X} \mathbf{F}_{oo} \f$
+ *
+ * which costs \f$ O(n_{o} n_{v} (n_{o} + n_{v})) \f$ and never forms
+ * the [nov, nov] matrix.
+ *
+ * \f$ (\mathbf{E} - \omega) \mathbf{x} = \mathbf{b} \f$ is solved by
+ * preconditioned conjugate gradient. The preconditioner is the exact
+ * inverse of the Sylvester-type operator \f$ \mathbf{E} - \omega
+ * \mathbf{S}_{vv} \otimes \mathbf{S}_{oo} \f$, applied in the basis
+ * that simultaneously diagonalizes each (F, S) pair. Since the
+ * fragment MOs are close to orthonormal, it usually converges in a
+ * few iterations. At frequencies where \f$ \mathbf{E} - \omega \f$
+ * is indefinite (above the lowest uncoupled excitation), CG doesn't
+ * apply, so those solves use left-preconditioned GMRES instead, with
+ * the absolute value of each denominator in the same
+ * preconditioner; neither forms the [nov, nov] matrix. For small
+ * systems, ediff_solver = dense diagonalizes the full matrix once
+ * instead.
+ */
+class ediff_nonorthogonal {
+
+protected:
+
+    size_t nocc;
+    size_t nvirt;
+
+    arma::mat F_oo;
+    arma::mat F_vv;
+    arma::mat S_oo;
+    arma::mat S_vv;
+
+    //! If reduced, the packed (ia) indices that are kept; the
+    //! operator then acts on vectors of only these elements.
+    arma::uvec indices;
+    bool is_reduced;
+
+    std::string solver; //!< "cg" or "dense"
+    double conv;        //!< relative residual norm threshold for CG
+    size_t maxiter;     //!< maximum number of CG (or GMRES) iterations
+    size_t gmres_restart; //!< Krylov subspace size for indefinite solves
+
+    //! Generalized eigenvectors, \f$ \mathbf{F}_{vv} \mathbf{U}_{v} =
+    //! \mathbf{S}_{vv} \mathbf{U}_{v} \mathbf{\Lambda}_{v} \f$ with
+    //! \f$ \mathbf{U}_{v}^{T} \mathbf{S}_{vv} \mathbf{U}_{v} = 1 \f$,
+    //! and the same for the occupied block.
+    arma::mat U_v;
+    arma::mat U_o;
+    arma::vec lambda_v;
+    arma::vec lambda_o;
+
+    //! Eigendecomposition of the full (symmetric) matrix, for solver
+    //! = dense only. It is computed once, so each solve for any
+    //! frequency is a diagonal shift costing \f$ O(n^2) \f$.
+    arma::mat dense_eigvec;
+    arma::vec dense_eigval;
+
+    void factor_dense();
+
+    /*!
+     * Solve from the full eigendecomposition.
+     */
+    void solve_dense(arma::vec &x, const arma::vec &b, double frequency) const;
+
+    /*!
+     * Solve by GMRES, for frequencies where \f$ \mathbf{E} - \omega \f$
+     * is indefinite.
+     */
+    void solve_gmres(arma::vec &x, const arma::vec &b, double frequency) const;
+
+    /*!
+     * Unpack a (possibly reduced) vector into a [nvirt, nocc] matrix.
+     */
+    void expand(arma::mat &X, const arma::vec &x) const;
+
+    /*!
+     * Pack a [nvirt, nocc] matrix into a (possibly reduced) vector.
+     */
+    void contract(arma::vec &x, const arma::mat &X) const;
+
+    /*!
+     * Apply the inverse of the Sylvester-type operator; with
+     * is_absolute, each denominator is replaced by its absolute value
+     * (floored away from zero).
+     */
+    void apply_precon(arma::vec &z, const arma::vec &r, double frequency, bool is_absolute) const;
+
+public:
+
+    ediff_nonorthogonal()
+        : nocc(0)
+        , nvirt(0)
+        , is_reduced(false)
+        , conv(0.0)
+        , maxiter(0)
+        , gmres_restart(0)
+        { }
+
+    /*!
+     * Set up the operator for one spin.
+     *
+     * @param[in] &F MO-basis Fock matrix, [norb, norb]
+     * @param[in] &S MO-basis overlap matrix, [norb, norb]
+     * @param[in] nocc_ number of occupied MOs
+     * @param[in] nvirt_ number of virtual MOs
+     * @param[in] &cfg options ("ediff_solver", "ediff_solver_conv", "ediff_solver_maxiter", "gmres_restart")
+     */
+    void init(
+        const arma::mat &F,
+        const arma::mat &S,
+        size_t nocc_,
+        size_t nvirt_,
+        const configurable &cfg
+        );
+
+    /*!
+     * Restrict the operator to a subset of the (ia) pairs; this is
+     * the matrix-free equivalent of make_masked_mat(..., true).
+     *
+     * @param[in] &indices_ packed (ia) indices to keep
+     */
+    void reduce(const arma::uvec &indices_);
+
+    /*!
+     * Dimension of the vectors the operator acts on.
+     */
+    size_t n_rows() const { return is_reduced ? indices.n_elem : nocc * nvirt; }
+
+    /*!
+     * \f$ \mathbf{y} = \mathbf{E}\mathbf{x} \f$
+     */
+    void apply(arma::vec &y, const arma::vec &x) const;
+
+    /*!
+     * Solve \f$ (\mathbf{E} - \omega) \mathbf{x} = \mathbf{b} \f$.
+     *
+     * @param[out] &x solution
+     * @param[in] &b RHS vector
+     * @param[in] frequency frequency of applied field in atomic units
+     */
+    void solve(arma::vec &x, const arma::vec &b, double frequency) const;
+
+    /*!
+     * Form the full (or, if reduced, the kept part of the) matrix,
+     * for solver = dense, printing and saving only.
+     */
+    arma::mat to_dense() const;
+
+};
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_LINEAR_EDIFF_NONORTHOGONAL_H_
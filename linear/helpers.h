@@ -7,6 +7,8 @@
  * Core routines called by the response solvers.
  */
 
+#include "ediff_nonorthogonal.h"
+#include "settings.h"
 #include "../indices.h"
 #include "../operator_spec.h"
 
@@ -31,6 +33,33 @@ void one_electron_mn_mats_to_ia_vecs(
     const arma::mat &C_virt
     );
 
+/*!
+ * one_electron_mn_mats_to_ia_vecs for every slice at once, with a
+ * scaling factor and optional mask applied while repacking.
+ *
+ * The slices of a cube are contiguous, so \f$ [\mathbf{M}_{1}
+ * \mathbf{M}_{2} \cdots] \f$ is transformed on the virtual side by a
+ * single GEMM with no copy, and the result is read as the input of a
+ * second single GEMM on the occupied side. The cost is that of the
+ * per-slice transformations, but in two large GEMMs instead of two
+ * small ones per slice.
+ *
+ * @param[out] &ia_vecs matrix of vectors of occ-virt MO integrals, [nocc*nvirt, n_slices]
+ * @param[in] &mn_mats cube of (square) AO integrals
+ * @param[in] &C_occ MO coefficients, occupied subspace (1 spin)
+ * @param[in] &C_virt MO coefficients, virtual subspace (1 spin)
+ * @param[in] factor every element is multiplied by this
+ * @param[in] *mask_rows if not NULL, only these {ia} are kept and the rest are zero
+ */
+void one_electron_mn_mats_to_ia_vecs_batched(
+    arma::mat &ia_vecs,
+    const arma::cube &mn_mats,
+    const arma::mat &C_occ,
+    const arma::mat &C_virt,
+    double factor,
+    const arma::uvec *mask_rows = NULL
+    );
+
 void one_electron_ia_vecs_to_mn_mats(
     arma::cube &mn_mats,
     const arma::mat &ia_vecs,
@@ -77,6 +106,21 @@ void compute_generalized_density(
     const arma::mat &C_virt
     );
 
+/*!
+ * As above, but with the [nbasis, nocc] intermediate \f$ C_{\mu b} q_{bj} \f$
+ * formed in caller-owned storage, so nothing is allocated once the
+ * workspace has the right size.
+ *
+ * @param[in,out] &work workspace, resized to [nbasis, nocc]
+ */
+void compute_generalized_density(
+    arma::mat &Dg,
+    const arma::vec &q,
+    const arma::mat &C_occ,
+    const arma::mat &C_virt,
+    arma::mat &work
+    );
+
 /*!
  * Form a guess for the response vector from the gradient/RHS vector and the denominator of virt-occ MO energy differences.
  *
@@ -103,6 +147,13 @@ void form_guess_rspvec(
     double frequency
     );
 
+void form_guess_rspvec(
+    arma::vec &rspvec,
+    const arma::vec &rhsvec,
+    const ediff_nonorthogonal &ediff,
+    double frequency
+    );
+
 /*!
  * Update the response vector from the previous iteration's matrix-vector product, the gradient/RHS vector, and the denominator of virt-occ MO energy differences.
  *
@@ -132,6 +183,36 @@ void form_new_rspvec(
     double frequency
     );
 
+void form_new_rspvec(
+    arma::vec &rspvec,
+    const arma::vec &product,
+    const arma::vec &rhsvec,
+    const ediff_nonorthogonal &ediff,
+    double frequency
+    );
+
+/*!
+ * Form the residual of the nonorthogonal response equations for a
+ * trial vector and its product.
+ *
+ * \f$ \mathbf{r} = \mathbf{b} - (\mathbf{E} - \omega)\mathbf{x} - \mathbf{G}\mathbf{x} \f$
+ *
+ * @param[out] &residual residual vector
+ * @param[in] &rspvec trial vector the product was formed from
+ * @param[in] &product orbital Hessian-trial vector product
+ * @param[in] &rhsvec packed vector of occ-virt gradient/RHS integrals
+ * @param[in] &ediff one-electron part of the orbital Hessian
+ * @param[in] frequency frequency of applied field in atomic units
+ */
+void form_residual(
+    arma::vec &residual,
+    const arma::vec &rspvec,
+    const arma::vec &product,
+    const arma::vec &rhsvec,
+    const ediff_nonorthogonal &ediff,
+    double frequency
+    );
+
 /*!
  * Contract each property vector with each response vector to form the final linear response values.
  *
@@ -179,6 +260,19 @@ void form_results(
     const arma::uvec &indices_mo
     );
 
+/*!
+ * Contract the property vectors of all operators with the response
+ * vectors of all operators that have them.
+ *
+ * The vectors are referenced in place and packed once per spin, so
+ * each slice of the results is a single \f$ \mathbf{P}^{T}\mathbf{X} \f$
+ * GEMM. With indices_mo, only the given rows are gathered.
+ *
+ * @param[out] &results [n_components, n_components, nden]; only the
+ *             columns for operators with response vectors are set
+ * @param[in] &operators
+ * @param[in] *indices_mo optional MO (ia) indices for each spin
+ */
 void form_results(
     arma::cube &results,
     const std::vector<operator_spec> &operators,
@@ -224,16 +318,93 @@ arma::cube weight_to_pct(const arma::cube &weights);
  * @param[out] &orbhess orbital Hessian, shape \f$ [\mu,\nu] \f$
  * @param[in] &J generalized Coulomb matrices, shape \f$ [\mu,\nu] \f$, precontracted with \f$ D_{\mu\nu}[X_{jb}] \f$
  * @param[in] &K generalized exchange matrices, shape \f$ [\mu,\nu] \f$, precontracted with \f$ D_{\mu\nu}[X_{jb}] \f$
- * @param[in] &hamiltonian "rpa" or "tda"
- * @param[in] &spin "singlet" or "triplet"
+ * @param[in] hamiltonian RPA or TDA
+ * @param[in] spin singlet or triplet
  * @param[in] b_prefactor 1 or -1 (relevant for RPA, not TDA)
  */
 void form_orbital_hessian_equations(
     arma::cube &orbhess,
     const arma::cube &J,
     const arma::cube &K,
-    const std::string &hamiltonian,
-    const std::string &spin,
+    hamiltonian_type hamiltonian,
+    spin_type spin,
+    int b_prefactor
+    );
+
+/*!
+ * Occupied and virtual MO coefficients for a fixed number of spins,
+ * NDEN = 1 (restricted) or 2 (unrestricted), so the routines that
+ * take them are specialized at compile time with no beta branches
+ * for restricted references.
+ *
+ * Packed vectors over both spins are alpha then beta (see
+ * join_vector); ov_offset gives where each spin starts. Matrices
+ * over the occupied MOs of both spins are [nbasis, nocc_tot], with
+ * each spin starting at column occ_offset.
+ */
+template <size_t NDEN>
+struct spin_orbitals {
+
+    arma::mat C_occ[NDEN];
+    arma::mat C_virt[NDEN];
+    size_t nocc[NDEN];
+    size_t nvirt[NDEN];
+    size_t occ_offset[NDEN];
+    size_t ov_offset[NDEN];
+    size_t nocc_tot;
+    size_t nov_tot;
+
+    //! The occupied MO coefficients of every spin side by side,
+    //! repeated once per spin down the rows, [NDEN * nbasis,
+    //! nocc_tot]. Since the J slices of a cube are contiguous, J
+    //! summed over spins is applied to the occupied MOs of every
+    //! spin with one GEMM against this.
+    arma::mat C_occ_stacked;
+
+    spin_orbitals();
+
+    /*!
+     * @param[in] &C MO coefficients, NDEN slices
+     * @param[in] &occupations nocc_alph, nvirt_alph, nocc_beta, nvirt_beta
+     */
+    void init(const arma::cube &C, const arma::uvec &occupations);
+
+};
+
+/*!
+ * Form the orbital Hessian-vector product directly from \f$
+ * J_{\mu\nu}^{X} \f$ and \f$ K_{\mu\nu}^{X} \f$, fusing
+ * form_orbital_hessian_equations, AO2MO, and
+ * repack_matrix_to_vector.
+ *
+ * Every case of form_orbital_hessian_equations has the form \f$
+ * \mathbf{G} = \alpha \mathbf{J} - \mathbf{K} + \gamma
+ * \mathbf{K}^{T} \f$ (with \f$ \mathbf{J} \f$ summed over spins
+ * for unrestricted references). The Coulomb term for all spins is
+ * one GEMM against spin_orbitals::C_occ_stacked, the exchange
+ * terms are accumulated per spin, taking the transpose of \f$
+ * \mathbf{K} \f$ as a GEMM flag rather than a copy, and the
+ * virtual index is transformed straight into the product vector. No
+ * [nbasis, nbasis] temporaries are formed.
+ *
+ * @param[out] &product packed product vector, alpha then beta (see join_vector)
+ * @param[in,out] &work workspace, resized to [nbasis, nocc_tot]
+ * @param[in] &J generalized Coulomb matrices, one slice per spin
+ * @param[in] &K generalized exchange matrices, one slice per spin
+ * @param[in] &orbs MO coefficients
+ * @param[in] hamiltonian RPA or TDA
+ * @param[in] spin singlet or triplet
+ * @param[in] b_prefactor 1 or -1 (relevant for RPA, not TDA)
+ */
+template <size_t NDEN>
+void form_orbital_hessian_products(
+    arma::vec &product,
+    arma::mat &work,
+    const arma::cube &J,
+    const arma::cube &K,
+    const spin_orbitals<NDEN> &orbs,
+    hamiltonian_type hamiltonian,
+    spin_type spin,
     int b_prefactor
     );
 
@@ -12,10 +12,31 @@
 #include "../configurable.h"
 #include "../matvec_i.h"
 #include "../operator_spec.h"
+#include "../parallel.h"
+#include "../timings.h"
 #include "iterator.h"
 
 namespace libresponse {
 
+/*!
+ * Receives the converged response vectors of each frequency from
+ * solve_linear_response, while the operators still hold them (only
+ * one frequency's are kept in memory at a time).
+ */
+class response_vector_sink {
+
+public:
+
+    virtual ~response_vector_sink() { }
+
+    /*!
+     * @param[in] frequency frequency that just converged
+     * @param[in] &operators operators holding its response vectors (in their matrices or a store)
+     */
+    virtual void converged(double frequency, const std::vector<operator_spec> &operators) = 0;
+
+};
+
 /*!
  * Solve the linear response equations for \f$\left\langle\left\langle \hat{V};\hat{W} \right\rangle\right\rangle_\omega \f$.
  *
@@ -27,14 +48,28 @@ namespace libresponse {
  * duplicate the MO coefficients in a second cube slice and the MO
  * energies in a second matrix column.
  *
+ * Thread safety: independent solves may run concurrently from
+ * different threads. Each needs its own results, matvec,
+ * solver_iterator, operators and timings; C, moene, occupations,
+ * omega and cfg are only read and can be shared between them. Files
+ * (save, checkpoints, restart, timings_json) are named from the
+ * prefix option, so concurrent solves that write any need different
+ * prefixes, and their printing is interleaved unless print_level is
+ * 0. num_threads applies to the calling thread only, including the
+ * parallel regions matvec opens from it.
+ *
  * @param[out] &results Linear response values for all possible V and W operators, one slice per frequency.
  * @param[in] *matvec Two-electron integral computation object.
+ * @param[in,out] *solver_iterator iterator to solve with, or NULL for a SolverIterator_linear owned by this call; it is reset() first, so it can be reused between calls
  * @param[in] &C MO coeffcients, 1 slice per alpha/beta spin
  * @param[in] &moene energies of all MOs, 1 column per alpha/beta spin
  * @param[in] &occupations 4 elements: nocc_alpha, nvirt_alpha, nocc_beta, nvirt_beta; if RHF, pass identical values for alpha and beta
  * @param[in] &omega One or more field frequencies in atomic units.
  * @param[in] &operators One or more operators to find LR values for.
  * @param[in] &cfg Map to hold configuration for solver
+ * @param[in,out] *timings optional per-phase timings and iteration counts to accumulate into
+ * @param[in] *comm optional ranks to split the components or frequencies over (see "mpi_distribute"); every rank must make the same call, with its own matvec, and all get the full results
+ * @param[in,out] *sink optional receiver of the response vectors of each frequency solved here, on the rank that solved it; frequencies finished before a restart aren't passed on
  */
 void solve_linear_response(
     arma::cube &results,
@@ -45,7 +80,10 @@ void solve_linear_response(
     const arma::uvec &occupations,
     const std::vector<double> &omega,
     std::vector<operator_spec> &operators,
-    const configurable &cfg
+    const configurable &cfg,
+    timing_summary *timings = NULL,
+    const communicator *comm = NULL,
+    response_vector_sink *sink = NULL
     );
 
 } // namespace libresponse
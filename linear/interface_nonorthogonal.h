@@ -12,10 +12,18 @@
 #include "../configurable.h"
 #include "../matvec_i.h"
 #include "../operator_spec.h"
+#include "../timings.h"
 #include "iterator.h"
 
 namespace libresponse {
 
+/*!
+ * Solve the linear response equations for a nonorthogonal
+ * (fragment-blocked) reference. The thread safety contract is the
+ * same as for the orthogonal solve_linear_response.
+ *
+ * @param[in,out] *solver_iterator iterator to solve with, or NULL for a SolverIterator_ALMO_linear owned by this call
+ */
 void solve_linear_response(
     arma::cube &results,
     MatVec_i *matvec,
@@ -27,7 +35,45 @@ void solve_linear_response(
     const arma::mat &S,
     const std::vector<double> &omega,
     std::vector<operator_spec> &operators,
-    const configurable &cfg
+    const configurable &cfg,
+    timing_summary *timings = NULL
+    );
+
+/*!
+ * Solve the nonorthogonal linear response equations for each
+ * fragment responding on its own, as a separate run with
+ * "_frgm_response_idx" = 1, 2, ... would, in a single call.
+ *
+ * The setup (MO-basis Fock and overlap matrices, energy differences
+ * and right-hand sides) is done once and shared. The fragment solves
+ * then run concurrently, one per entry of matvecs at a time, each
+ * with its own SolverIterator_ALMO_linear and copies of the
+ * operators; the matvecs must be distinct objects, per the thread
+ * safety contract of solve_linear_response. Threads beyond one per
+ * worker are only used within a solve if the OpenMP runtime allows
+ * nested parallelism, so for few fragments a single matvec (which
+ * solves them one after another with every thread) may be faster.
+ *
+ * Anything saved goes under <prefix>frgm<i>. for fragment i; with
+ * more than one worker, only the final results are printed. The
+ * operators are left with the unmasked property vectors, and not
+ * any fragment's response vectors.
+ *
+ * @param[out] &results one cube per fragment, each as from solve_linear_response
+ * @param[in] &matvecs one two-electron integral computation object per concurrent fragment solve
+ */
+void solve_linear_response_fragments(
+    std::vector<arma::cube> &results,
+    const std::vector<MatVec_i *> &matvecs,
+    const arma::cube &C,
+    const arma::umat &fragment_occupations,
+    const arma::uvec &occupations,
+    const arma::cube &F,
+    const arma::mat &S,
+    const std::vector<double> &omega,
+    std::vector<operator_spec> &operators,
+    const configurable &cfg,
+    timing_summary *timings = NULL
     );
 
 } // namespace libresponse
@@ -7,54 +7,136 @@
  * ...
  */
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
 #include "helpers.h"
 #include "printing.h"
+#include "solvers.h"
+#include "../fragment_blocks.h"
 #include "../matvec_i.h"
+#include "../parallel.h"
+#include "../timings.h"
 
 namespace libresponse {
 
+/*!
+ * Copy between cubes of the same size but different precision,
+ * elementwise and without allocating.
+ */
+template <typename eT_to, typename eT_from>
+inline void copy_convert(arma::Cube<eT_to> &to, const arma::Cube<eT_from> &from)
+{
+
+    assert(to.n_elem == from.n_elem);
+    std::copy(from.memptr(), from.memptr() + from.n_elem, to.memptr());
+
+    return;
+
+}
+
+/*!
+ * Storage for applying the orbital Hessian to a block of trial
+ * vectors, sized once for the largest block so that the steady-state
+ * iterations make no heap allocations. Smaller blocks use views over
+ * the leading part of each buffer.
+ */
+struct solver_workspace {
+
+    size_t nvec_max;     //!< largest number of trial vectors per block
+    arma::mat vecs;      //!< trial vectors, [nov_tot, nvec_max]
+    arma::mat products;  //!< orbital Hessian-trial vector products, [nov_tot, nvec_max]
+    arma::cube Dg;       //!< generalized densities, nden slices per trial vector
+    arma::cube J;        //!< generalized Coulomb matrices, same layout as Dg
+    arma::cube K;        //!< generalized exchange matrices, same layout as Dg
+    std::vector<arma::mat> L; //!< left coefficients (only used without Dg)
+    std::vector<arma::mat> R; //!< right coefficients (only used without Dg)
+    arma::mat half;      //!< [nbasis, nocc_alph + nocc_beta] intermediate, alpha columns first
+    arma::vec density_norms; //!< norm of each density, same layout as Dg
+    // Single-precision copies, only allocated for mixed precision.
+    arma::fcube Dg_f;
+    arma::fcube J_f;
+    arma::fcube K_f;
+    std::vector<arma::fmat> L_f;
+    std::vector<arma::fmat> R_f;
+
+    solver_workspace() : nvec_max(0) { }
+
+    void reserve(
+        size_t nbasis, size_t nov_tot, size_t nden, size_t nvec_max_,
+        size_t nocc_alph, size_t nocc_beta,
+        bool do_compute_generalized_density,
+        bool single_precision
+        )
+        {
+
+            nvec_max = nvec_max_;
+            vecs.set_size(nov_tot, nvec_max);
+            products.set_size(nov_tot, nvec_max);
+            density_norms.set_size(nden * nvec_max);
+            J.set_size(nbasis, nbasis, nden * nvec_max);
+            K.set_size(nbasis, nbasis, nden * nvec_max);
+            if (do_compute_generalized_density)
+                Dg.set_size(nbasis, nbasis, nden * nvec_max);
+            else
+                Dg.reset();
+            // R caches the occupied MO coefficients, which may differ
+            // between runs.
+            L.clear();
+            R.clear();
+            L_f.clear();
+            R_f.clear();
+            if (single_precision) {
+                J_f.set_size(nbasis, nbasis, nden * nvec_max);
+                K_f.set_size(nbasis, nbasis, nden * nvec_max);
+                if (do_compute_generalized_density)
+                    Dg_f.set_size(nbasis, nbasis, nden * nvec_max);
+                else
+                    Dg_f.reset();
+            } else {
+                J_f.reset();
+                K_f.reset();
+                Dg_f.reset();
+            }
+            half.set_size(nbasis, nocc_alph + ((nden == 2) ? nocc_beta : 0));
+
+            return;
+
+        }
+
+};
+
+/*!
+ * State for iterating one solve's response equations.
+ *
+ * Everything that changes during a solve (workspace, per-component
+ * solvers, restart state) is owned by the instance, and the inputs
+ * given to init() are only read, so separate instances can run
+ * concurrently. A single instance must not be used by two solves at
+ * once.
+ */
 template <class T>
 class SolverIterator_i {
 
 protected:
 
-    // Intermediates that aren't needed outside the iterations:
-    // Dg, J, K, products, ints_ovov, ints_mnov, rspvecs_old
-
-    // Hold the generalized density (the response vector in the AO
-    // basis) and the resulting J/K formed from that density.
-    arma::cube Dg;
-    arma::cube J;
-    arma::cube K;
-
-    // Do compute the generalized density Dg, or keep L and R
-    // separately?
+    // Do compute the generalized density Dg, or pass its factors
+    // L = C_virt X and R = C_occ to the J/K engine?
     bool do_compute_generalized_density;
-    // TODO comment me!
-    std::vector<arma::mat> L;
-    std::vector<arma::mat> R;
-    arma::mat L_alph;
-    arma::mat L_beta;
-    arma::mat R_alph;
-    arma::mat R_beta;
-
-    // These are for the intermediate integrals (2 transformed
-    // indices).
-    arma::cube ints_mnov;
-    // These are for the 4-index transformed integrals; upon
-    // repacking into a vector, these are the matrix-vector
-    // products (see above).
-    arma::mat ints_ovov_alph;
-    arma::mat ints_ovov_beta;
+    // Storage for form_products, sized once per run.
+    solver_workspace ws;
 
     size_t nden;
-    // These are present in the initialization.
-    libresponse::configurable * cfg;
+    // These are present in the initialization. The inputs are only
+    // read; the operators (vectors written back) and the J/K engine
+    // belong to this solve alone.
+    const libresponse::configurable * cfg;
     std::vector<operator_spec> * operators;
     MatVec_i * matvec;
-    arma::cube * C;
-    T * ediff_alph;
-    T * ediff_beta;
+    const arma::cube * C;
+    const T * ediff_alph;
+    const T * ediff_beta;
     double frequency;
     int maxiter;
     double conv;
@@ -62,13 +144,300 @@ protected:
     size_t nocc_alph, nvirt_alph, nocc_beta, nvirt_beta;
     size_t nov_alph, nov_beta;
 
+    // Occupied and virtual MO coefficient blocks for the
+    // compile-time specialized routines; only the one matching nden
+    // is set up.
+    spin_orbitals<1> orbs_rhf;
+    spin_orbitals<2> orbs_uhf;
+
+    // Parsed once per init(), so nothing is looked up from cfg
+    // inside the iterations.
+    solver_settings settings;
+
     int print_level;
 
+    // Restart checkpoint state. The frequency index and results are
+    // owned by solve_linear_response; restart_source is only set
+    // for the run that resumes from a checkpoint.
+    size_t frequency_index;
+    const arma::cube * results_alph;
+    const arma::cube * results_beta;
+    const checkpoint_reader * restart_source;
+    int checkpoint_interval;
+
+    // Owned by the caller; NULL when timing isn't requested.
+    timing_summary * timings;
+
+    // Owned by the caller; NULL (or a single rank) when not
+    // distributed.
+    const communicator * comm;
+
+    std::string restart_filename() const
+        {
+
+            return settings.prefix + "restart.chk";
+
+        }
+
+    /*!
+     * Write the solver-specific part of the restart checkpoint.
+     */
+    virtual void save_state(checkpoint_writer &chk) const { }
+
+    /*!
+     * Restore the solver-specific part of the restart
+     * checkpoint. Called from run() after the solver state has been
+     * set up for the current frequency.
+     */
+    virtual void load_state(const checkpoint_reader &chk) { }
+
+    /*!
+     * Apply the two-electron part of the orbital Hessian to a block
+     * of trial vectors using a single call to the J/K engine.
+     *
+     * Each column of vecs is a trial vector over the combined
+     * occ-virt space, with alpha first and then beta for
+     * unrestricted references (see join_vector). The generalized
+     * densities for all columns are packed into one cube as (alpha,
+     * beta) pairs, so the MatVec_i engine sees nden * vecs.n_cols
+     * slices.
+     *
+     * @param[out] &products orbital Hessian-trial vector products, same shape as vecs
+     * @param[in] &vecs trial vectors (each column)
+     * @param[in] &b_prefactors B matrix prefactor for each column
+     * @param[in] single if true, build J/K in single precision
+     */
+    void form_products(
+        arma::mat &products,
+        const arma::mat &vecs,
+        const std::vector<int> &b_prefactors,
+        bool single = false
+        )
+        {
+
+            // The only runtime branch on the number of spins.
+            if (nden == 2)
+                form_products_spin(orbs_uhf, products, vecs, b_prefactors, single);
+            else
+                form_products_spin(orbs_rhf, products, vecs, b_prefactors, single);
+
+            return;
+
+        }
+
+    /*!
+     * form_products for a fixed number of spins.
+     */
+    template <size_t NDEN>
+    void form_products_spin(
+        const spin_orbitals<NDEN> &orbs,
+        arma::mat &products,
+        const arma::mat &vecs,
+        const std::vector<int> &b_prefactors,
+        bool single
+        )
+        {
+
+            const size_t nvec = vecs.n_cols;
+            const size_t nbasis = C->n_rows;
+            const size_t nslices = NDEN * nvec;
+
+            assert(b_prefactors.size() == nvec);
+            assert(vecs.n_rows == orbs.nov_tot);
+            assert(nvec <= ws.nvec_max);
+
+            products.set_size(vecs.n_rows, nvec);
+
+            // Views over the first nvec trial vectors' worth of
+            // workspace.
+            arma::cube J_blk(ws.J.memptr(), nbasis, nbasis, nslices, false, true);
+            arma::cube K_blk(ws.K.memptr(), nbasis, nbasis, nslices, false, true);
+            assert(!single || ws.J_f.n_slices >= nslices);
+
+            // Let the engine know how large each density is, so it
+            // can screen more tightly when they're small (as for
+            // incremental builds). These are the norms of the MO
+            // parts, which equal the AO norms for orthonormal MOs.
+            arma::vec norms(ws.density_norms.memptr(), nslices, false, true);
+            for (size_t v = 0; v < nvec; v++) {
+                for (size_t d = 0; d < NDEN; d++) {
+                    const arma::vec vec_d(const_cast<double *>(vecs.colptr(v)) + orbs.ov_offset[d], orbs.nocc[d] * orbs.nvirt[d], false, true);
+                    norms(NDEN * v + d) = arma::norm(vec_d, 2);
+                }
+            }
+            matvec->set_density_norms(norms);
+
+            scoped_timer timer_density(timings, PHASE_DENSITY);
+            if (do_compute_generalized_density) {
+                // Compute J and K from D.
+                arma::cube Dg_blk(ws.Dg.memptr(), nbasis, nbasis, nslices, false, true);
+                for (size_t v = 0; v < nvec; v++) {
+                    for (size_t d = 0; d < NDEN; d++) {
+                        const arma::vec rspvec_d(const_cast<double *>(vecs.colptr(v)) + orbs.ov_offset[d], orbs.nocc[d] * orbs.nvirt[d], false, true);
+                        arma::mat Dg_d(Dg_blk.slice_memptr(NDEN * v + d), nbasis, nbasis, false, true);
+                        arma::mat half_d(ws.half.colptr(orbs.occ_offset[d]), nbasis, orbs.nocc[d], false, true);
+                        compute_generalized_density(Dg_d, rspvec_d, orbs.C_occ[d], orbs.C_virt[d], half_d);
+                    }
+                }
+
+                timer_density.stop();
+
+                if (print_level >= 10)
+                    pretty_print(Dg_blk, "Dg");
+
+                const scoped_timer timer_jk(timings, PHASE_JK);
+                if (single) {
+                    // The rest is done in double precision either
+                    // way.
+                    arma::fcube Dg_blk_f(ws.Dg_f.memptr(), nbasis, nbasis, nslices, false, true);
+                    arma::fcube J_blk_f(ws.J_f.memptr(), nbasis, nbasis, nslices, false, true);
+                    arma::fcube K_blk_f(ws.K_f.memptr(), nbasis, nbasis, nslices, false, true);
+                    copy_convert(Dg_blk_f, Dg_blk);
+                    matvec->compute(J_blk_f, K_blk_f, Dg_blk_f);
+                    copy_convert(J_blk, J_blk_f);
+                    copy_convert(K_blk, K_blk_f);
+                } else {
+                    matvec->compute(J_blk, K_blk, Dg_blk);
+                }
+            } else {
+                // Compute J and K from L and R, factored with the
+                // occupied rank: Dg = (C_virt q) C_occ^T. R is always
+                // the occupied MO coefficients, so it is only set
+                // when an entry is first used.
+                ws.L.resize(nslices);
+                ws.R.resize(nslices);
+                for (size_t v = 0; v < nvec; v++) {
+                    for (size_t d = 0; d < NDEN; d++) {
+                        if (ws.R[NDEN * v + d].is_empty())
+                            ws.R[NDEN * v + d] = orbs.C_occ[d];
+                        const arma::mat qm_d(const_cast<double *>(vecs.colptr(v)) + orbs.ov_offset[d], orbs.nvirt[d], orbs.nocc[d], false, true);
+                        ws.L[NDEN * v + d] = orbs.C_virt[d] * qm_d;
+                    }
+                }
+                if (single) {
+                    ws.L_f.resize(nslices);
+                    ws.R_f.resize(nslices);
+                    for (size_t ls = 0; ls < nslices; ls++) {
+                        if (ws.R_f[ls].is_empty())
+                            ws.R_f[ls] = arma::conv_to<arma::fmat>::from(ws.R[ls]);
+                        ws.L_f[ls] = arma::conv_to<arma::fmat>::from(ws.L[ls]);
+                    }
+                }
+                timer_density.stop();
+                const scoped_timer timer_jk(timings, PHASE_JK);
+                if (single) {
+                    arma::fcube J_blk_f(ws.J_f.memptr(), nbasis, nbasis, nslices, false, true);
+                    arma::fcube K_blk_f(ws.K_f.memptr(), nbasis, nbasis, nslices, false, true);
+                    matvec->compute(J_blk_f, K_blk_f, ws.L_f, ws.R_f);
+                    copy_convert(J_blk, J_blk_f);
+                    copy_convert(K_blk, K_blk_f);
+                } else {
+                    matvec->compute(J_blk, K_blk, ws.L, ws.R);
+                }
+            }
+
+            if (print_level >= 10) {
+                pretty_print(J_blk, "J");
+                pretty_print(K_blk, "K");
+            }
+
+            // The fused kernel also does the AO2MO transformation.
+            const scoped_timer timer_hessian(timings, PHASE_HESSIAN);
+            for (size_t v = 0; v < nvec; v++) {
+
+                // Views over the spin slices belonging to this trial
+                // vector.
+                const arma::cube J_v(J_blk.slice_memptr(NDEN * v), nbasis, nbasis, NDEN, false, true);
+                const arma::cube K_v(K_blk.slice_memptr(NDEN * v), nbasis, nbasis, NDEN, false, true);
+
+                arma::vec product(products.colptr(v), vecs.n_rows, false, true);
+                form_orbital_hessian_products(
+                    product, ws.half, J_v, K_v, orbs,
+                    settings.hamiltonian, settings.spin, b_prefactors[v]);
+
+            }
+
+            return;
+
+        }
+
 public:
 
-    SolverIterator_i() { }
+    SolverIterator_i()
+        : frequency_index(0)
+        , results_alph(NULL)
+        , results_beta(NULL)
+        , restart_source(NULL)
+        , checkpoint_interval(0)
+        , timings(NULL)
+        , comm(NULL)
+        { }
     virtual ~SolverIterator_i() { }
 
+    /*!
+     * Accumulate per-phase timings and iteration counts into
+     * timings_ (or stop, for NULL).
+     */
+    void set_timings(timing_summary * timings_) { timings = timings_; }
+
+    /*!
+     * Split the work of each run() over the ranks of comm_ (or stop,
+     * for NULL). Every rank must call run() the same number of
+     * times, since the results are combined with collectives.
+     */
+    void set_communicator(const communicator * comm_) { comm = comm_; }
+
+    /*!
+     * Pass the state that solve_linear_response owns but that needs
+     * to be part of a restart checkpoint.
+     *
+     * @param[in] frequency_index_ index of the frequency being solved for
+     * @param[in] *results_alph_ results for all frequencies (only those before frequency_index_ are final)
+     * @param[in] *results_beta_ same as results_alph_, beta spin (may be empty)
+     * @param[in] *restart_source_ checkpoint to continue the next run() from, or NULL
+     */
+    void set_restart(
+        size_t frequency_index_,
+        const arma::cube * results_alph_,
+        const arma::cube * results_beta_,
+        const checkpoint_reader * restart_source_
+        )
+        {
+
+            frequency_index = frequency_index_;
+            results_alph = results_alph_;
+            results_beta = results_beta_;
+            restart_source = restart_source_;
+
+            return;
+
+        }
+
+    /*!
+     * Write a restart checkpoint.
+     *
+     * @param[in] with_state if true, save the live solver state so
+     * the current frequency can be continued; otherwise, mark the
+     * current frequency as finished
+     */
+    void write_restart(bool with_state) const
+        {
+
+            const scoped_timer timer(timings, PHASE_IO);
+            checkpoint_writer chk(restart_filename());
+            chk.add_scalar("frequency_index", with_state ? frequency_index : (frequency_index + 1));
+            if (results_alph != NULL)
+                chk.add("results_alph", *results_alph);
+            if (results_beta != NULL && !results_beta->is_empty())
+                chk.add("results_beta", *results_beta);
+            if (with_state)
+                save_state(chk);
+            chk.close();
+
+            return;
+
+        }
+
     void set_orbital_occupations(
         size_t nocc_alph_, size_t nvirt_alph_,
         size_t nocc_beta_, size_t nvirt_beta_
@@ -89,11 +458,11 @@ public:
 
     void init(
         std::vector<operator_spec> * operators_,
-        configurable * cfg_,
+        const configurable * cfg_,
         MatVec_i * matvec_,
-        arma::cube * C_,
-        T * ediff_alph_,
-        T * ediff_beta_,
+        const arma::cube * C_,
+        const T * ediff_alph_,
+        const T * ediff_beta_,
         double frequency_,
         int maxiter_,
         double conv_
@@ -112,261 +481,727 @@ public:
 
             nden = C->n_slices;
 
-            const size_t nbasis = C->n_rows;
-            do_compute_generalized_density = cfg->get_param<bool>("_do_compute_generalized_density");
-            if (do_compute_generalized_density)
-                Dg.set_size(nbasis, nbasis, nden);
-            else {
-                L_alph.set_size(nbasis, nvirt_alph);
-                R_alph.set_size(nbasis, nvirt_alph);
-                L.push_back(L_alph);
-                R.push_back(R_alph);
-                if (nden == 2) {
-                    L_beta.set_size(nbasis, nvirt_beta);
-                    R_beta.set_size(nbasis, nvirt_beta);
-                    L.push_back(L_beta);
-                    R.push_back(R_beta);
-                }
-            }
-            J.set_size(nbasis, nbasis, nden);
-            K.set_size(nbasis, nbasis, nden);
-            ints_mnov.set_size(nbasis, nbasis, nden);
-            ints_ovov_alph.set_size(nvirt_alph, nocc_alph);
-            if (nden == 2) {
-                ints_ovov_beta.set_size(nvirt_beta, nocc_beta);
-            }
-
-            print_level = std::atoi(cfg->get_param("print_level").c_str());
+            settings.init(*cfg);
+
+            // Anything else the iterations need is either in the
+            // workspace, which is sized for the components in run(),
+            // or belongs to a particular iterator.
+            // The ALMO AO density mask can only be applied to P.
+            if (settings.density_form == DENSITY_FORM_AUTO)
+                do_compute_generalized_density = !matvec->prefers_factored_densities() || settings.mask_dg_ao;
+            else
+                do_compute_generalized_density = (settings.density_form == DENSITY_FORM_DENSE);
+
+            arma::uvec occupations(4);
+            occupations(0) = nocc_alph;
+            occupations(1) = nvirt_alph;
+            occupations(2) = nocc_beta;
+            occupations(3) = nvirt_beta;
+            if (nden == 2)
+                orbs_uhf.init(*C, occupations);
+            else
+                orbs_rhf.init(*C, occupations);
+
+            // Only the root rank prints.
+            print_level = (comm == NULL || comm->is_root()) ? settings.print_level : 0;
+            checkpoint_interval = settings.checkpoint_interval;
 
         }
 
 
+    /*!
+     * Forget anything kept between run()s for a frequency sweep.
+     * solve_linear_response calls this before its first frequency,
+     * so a reused iterator never builds on products formed for
+     * another system, set of operators or Hessian.
+     */
+    virtual void reset() { }
+
     virtual void run() { }
 
 };
 
+/*!
+ * A single (operator, component) pair whose response vector is being
+ * converged.
+ */
+struct rspvec_component {
+    size_t i;        //!< index into the operator list
+    size_t s;        //!< slice/component of that operator
+    int b_prefactor; //!< B matrix prefactor for the operator
+    bool is_converged;
+    size_t n_iter;   //!< number of iterations taken so far
+};
+
 class SolverIterator_linear : public SolverIterator_i<arma::vec> {
 
-public:
+protected:
 
-    void run() {
+    // One solver (Jacobi, DIIS, CG, GMRES) per component, chosen by
+    // the "solver" option, and the diagonal preconditioner they all
+    // share.
+    std::vector<LinearSolver_i *> solvers;
+    arma::vec precon;
+
+    void clear_solvers()
+        {
+
+            for (size_t c = 0; c < solvers.size(); c++)
+                delete solvers[c];
+            solvers.clear();
+
+            return;
 
-        // These are for the previous iteration's response vectors,
-        // used for calculating the RMSD between steps.
-        std::vector< arma::mat > rspvecs_old_alph;
-        for (size_t i = 0; i < operators->size(); i++) {
-            if (operators->at(i).do_response)
-                rspvecs_old_alph.push_back(arma::mat(nov_alph, operators->at(i).integrals_ao.n_slices));
         }
-        std::vector< arma::mat > rspvecs_old_beta;
-        // These are for the matrix-vector products between the
-        // orbital Hessian and the trial/guess response vector at a
-        // single iteration.
-        std::vector< arma::mat > products_alph;
-        for (size_t i = 0; i < operators->size(); i++) {
-            if (operators->at(i).do_response)
-                products_alph.push_back(arma::mat(nov_alph, operators->at(i).integrals_ao.n_slices, arma::fill::zeros));
+
+    // All components being solved for, in operator order.
+    std::vector<rspvec_component> components;
+
+    // With convergence = residual, the threshold for the current
+    // iteration.
+    double conv_residual;
+
+    // conv, or with conv_property, the residual at which the
+    // first-order error it leaves in any result, |x_A . r| <=
+    // ||x_A|| ||r||, reaches the target. The x_A are the current
+    // vectors, so the threshold follows them as they converge;
+    // results for operators without response vectors aren't covered.
+    double residual_threshold() const
+        {
+
+            if (settings.conv_property <= 0.0)
+                return conv;
+
+            double norm_max = 0.0;
+            for (size_t c = 0; c < rspvecs.n_cols; c++)
+                norm_max = std::max(norm_max, arma::norm(rspvecs.col(c), 2));
+
+            return (norm_max > 0.0) ? (settings.conv_property / norm_max) : conv;
+
         }
-        std::vector< arma::mat > products_beta;
-        if (nden == 2) {
+
+    // Combined alpha/beta vectors for every component, one column
+    // per entry in components. Alpha occupies the first nov_alph
+    // rows, beta (if present) the remaining nov_beta rows.
+    arma::mat rspvecs;
+    arma::mat rspvecs_old;
+    arma::mat rhsvecs;
+
+    // For incremental Fock builds, the trial vector each component's
+    // products were last formed for, those products, and how many
+    // builds ago the last full (non-incremental) one was; -1 means
+    // there is nothing to build on yet.
+    arma::mat trials_prev;
+    arma::mat products_prev;
+    std::vector<int> fock_age;
+
+    // Copy the response and RHS vectors out of the operators into
+    // the combined storage.
+    void gather_components()
+        {
+
+            components.clear();
             for (size_t i = 0; i < operators->size(); i++) {
                 if (operators->at(i).do_response) {
-                    rspvecs_old_beta.push_back(arma::mat(nov_beta, operators->at(i).integrals_ao.n_slices));
-                    products_beta.push_back(arma::mat(nov_beta, operators->at(i).integrals_ao.n_slices, arma::fill::zeros));
+                    for (size_t s = 0; s < operators->at(i).ncomp; s++) {
+                        rspvec_component c;
+                        c.i = i;
+                        c.s = s;
+                        c.b_prefactor = operators->at(i).b_prefactor;
+                        c.is_converged = false;
+                        c.n_iter = 0;
+                        components.push_back(c);
+                    }
+                }
+            }
+
+            const size_t nov_tot = nov_alph + ((nden == 2) ? nov_beta : 0);
+            const size_t ncomp = components.size();
+            rspvecs.set_size(nov_tot, ncomp);
+            rspvecs_old.set_size(nov_tot, ncomp);
+            rhsvecs.set_size(nov_tot, ncomp);
+            if (settings.incremental_fock) {
+                trials_prev.set_size(nov_tot, ncomp);
+                products_prev.set_size(nov_tot, ncomp);
+            }
+            fock_age.assign(ncomp, -1);
+
+            if (nden == 2)
+                precon = ::join(*ediff_alph, *ediff_beta) - frequency;
+            else
+                precon = *ediff_alph - frequency;
+
+            for (size_t c = 0; c < ncomp; c++) {
+                const operator_spec &os = operators->at(components[c].i);
+                const size_t s = components[c].s;
+                // The operator's vectors may be in a vector_store.
+                os.get_response_vector(rspvecs.colptr(c), s, false);
+                os.get_property_vector(rhsvecs.colptr(c), s, false);
+                if (nden == 2) {
+                    os.get_response_vector(rspvecs.colptr(c) + nov_alph, s, true);
+                    os.get_property_vector(rhsvecs.colptr(c) + nov_alph, s, true);
                 }
             }
+
+            // Size the workspace for the largest block that will be
+            // iterated.
+            const size_t nvec_max = settings.solver_block ? std::max<size_t>(ncomp, 1) : 1;
+            ws.reserve(C->n_rows, nov_tot, nden, nvec_max, nocc_alph, nocc_beta, do_compute_generalized_density, settings.mixed_precision);
+
+            // When sweeping over frequencies, keep the solvers from the
+            // previous frequency so any subspace they hold is reused;
+            // reset() drops them before the next sweep.
+            const bool keep_solvers = settings.frequency_sweep && (solvers.size() == ncomp);
+            if (!keep_solvers) {
+                clear_solvers();
+                for (size_t c = 0; c < ncomp; c++)
+                    solvers.push_back(make_linear_solver(settings));
+            }
+            for (size_t c = 0; c < ncomp; c++)
+                solvers[c]->init(rspvecs.col(c), rhsvecs.col(c), precon);
+
+            return;
+
         }
 
-        iteration_info_linear info;
-        if (nden == 1)
-            info.has_beta = false;
-        else
-            info.has_beta = true;
+    // Copy a single component's response vector back into its
+    // operator. Converged vectors may be compressed by the
+    // operator's store.
+    void scatter_component(size_t c)
+        {
+
+            operator_spec &os = operators->at(components[c].i);
+            const size_t s = components[c].s;
+            const bool compress = components[c].is_converged;
+            os.set_response_vector(rspvecs.colptr(c), s, false, compress);
+            if (nden == 2)
+                os.set_response_vector(rspvecs.colptr(c) + nov_alph, s, true, compress);
+
+            return;
 
-        const std::string hamiltonian = cfg->get_param("hamiltonian");
-        const std::string spin = cfg->get_param("spin");
-        arma::mat C_occ_alph = C->slice(0).cols(0, nocc_alph - 1);
-        arma::mat C_virt_alph = C->slice(0).cols(nocc_alph, nocc_alph + nvirt_alph - 1);
-        arma::mat C_occ_beta;
-        arma::mat C_virt_beta;
-        if (nden == 2) {
-            C_occ_beta = C->slice(1).cols(0, nocc_beta - 1);
-            C_virt_beta = C->slice(1).cols(nocc_beta, nocc_beta + nvirt_beta - 1);
         }
 
-        // Perform the linear CPSCF iterations. Loop over operators,
-        // then components of that operator, converging each one
-        // separately.
-        for (size_t i = 0; i < operators->size(); i++) {
+    void print_component_header(size_t c) const
+        {
 
-            if (operators->at(i).do_response) {
+            const operator_spec &os = operators->at(components[c].i);
+            std::cout << \
+                "  Operator: " <<                            \
+                os.metadata.operator_label <<                \
+                " / component: " << components[c].s + 1 <<   \
+                " / origin: " <<                             \
+                os.metadata.origin_label <<                  \
+                std::endl;
 
-                const int b_prefactor = operators->at(i).b_prefactor;
+            return;
 
-                for (size_t s = 0; s < operators->at(i).integrals_ao.n_slices; s++) {
+        }
 
-                    bool is_converged = false;
+    /*!
+     * Hessian-vector products for the trial vectors in columns
+     * [v_begin, v_end) of the workspace, for active components.
+     *
+     * @param[in] &active indices into components, one per workspace column
+     * @param[in] &b_prefactors B matrix prefactor for each workspace column
+     * @param[in] v_begin first column
+     * @param[in] v_end one past the last column
+     * @param[in] single if true, build J/K in single precision
+     */
+    void build_products(
+        const std::vector<size_t> &active,
+        const std::vector<int> &b_prefactors,
+        size_t v_begin,
+        size_t v_end,
+        bool single
+        )
+        {
 
-                    if (print_level >= 2) {
-                        std::cout << \
-                            "  Operator: " <<                            \
-                            operators->at(i).metadata.operator_label <<  \
-                            " / component: " << s + 1 <<                 \
-                            " / origin: " <<                             \
-                            operators->at(i).metadata.origin_label <<    \
-                            std::endl;
+            const size_t nov_tot = rspvecs.n_rows;
+            const size_t nvec = v_end - v_begin;
+            if (nvec == 0)
+                return;
+
+            const arma::mat vecs(ws.vecs.colptr(v_begin), nov_tot, nvec, false, true);
+            arma::mat products(ws.products.colptr(v_begin), nov_tot, nvec, false, true);
+            const std::vector<int> b_prefactors_batch(b_prefactors.begin() + v_begin, b_prefactors.begin() + v_end);
+
+            form_products(products, vecs, b_prefactors_batch, single);
+
+            if (settings.incremental_fock) {
+                for (size_t v = 0; v < nvec; v++) {
+                    const size_t c = active[v_begin + v];
+                    if ((fock_age[c] < 0) || (fock_age[c] >= settings.incremental_fock_rebuild)) {
+                        fock_age[c] = 1;
+                    } else {
+                        products.col(v) += products_prev.col(c);
+                        fock_age[c]++;
                     }
+                    products_prev.col(c) = products.col(v);
+                }
+            }
 
-                    // Wrappers over vectors.
-                    arma::vec product_alph(products_alph[i].colptr(s), nov_alph, false, true);
-                    arma::vec rspvec_alph(operators->at(i).rspvecs_alph.colptr(s), nov_alph, false, true);
-                    arma::vec rspvec_old_alph(rspvecs_old_alph[i].colptr(s), nov_alph, false, true);
-                    const arma::vec rhsvec_alph(operators->at(i).integrals_mo_ai_alph.colptr(s), nov_alph, false, true);
+            return;
 
-                    // The Armadillo vectors need to pass through to
-                    // the correct memory locations, but the pointers
-                    // are undefined for 1 density since the
-                    // std::vectors are unpopulated.
-                    double * product_beta_ptr = NULL;
-                    double * rspvec_beta_ptr = NULL;
-                    double * rspvec_old_beta_ptr = NULL;
-                    double * rhsvec_beta_ptr = NULL;
-                    if (nden == 2) {
-                        product_beta_ptr = products_beta[i].colptr(s);
-                        rspvec_beta_ptr = operators->at(i).rspvecs_beta.colptr(s);
-                        rspvec_old_beta_ptr = rspvecs_old_beta[i].colptr(s);
-                        rhsvec_beta_ptr = operators->at(i).integrals_mo_ai_beta.colptr(s);
-                    }
-                    // This is safe even with null pointers, because I'm a
-                    // careful programmer...sometimes?
-                    arma::vec product_beta(product_beta_ptr, nov_beta, false, true);
-                    arma::vec rspvec_beta(rspvec_beta_ptr, nov_beta, false, true);
-                    arma::vec rspvec_old_beta(rspvec_old_beta_ptr, nov_beta, false, true);
-                    const arma::vec rhsvec_beta(rhsvec_beta_ptr, nov_beta, false, true);
+        }
 
-                    // Perform the response vector update.
-                    info.max_rmsd_alph = 0.0;
-                    info.max_rmsd_beta = 0.0;
-                    for (size_t iter = 0; iter < maxiter; iter++) {
+    /*!
+     * Update the solvers for the active components in workspace
+     * columns [v_begin, v_end) from their products, and check them
+     * for convergence.
+     *
+     * @param[in,out] &still_active unconverged components are appended
+     * @param[in,out] &info iteration printing
+     * @param[in] &active indices into components, one per workspace column
+     * @param[in] v_begin first column
+     * @param[in] v_end one past the last column
+     * @param[in] iter iteration number
+     * @param[in] is_block are these part of a block
+     * @param[in] single were the products built in single precision
+     * @return largest RMSD between iterations
+     */
+    double update_components(
+        std::vector<size_t> &still_active,
+        iteration_info_linear &info,
+        const std::vector<size_t> &active,
+        size_t v_begin,
+        size_t v_end,
+        size_t iter,
+        bool is_block,
+        bool single
+        )
+        {
 
-                        if (print_level >= 10) {
-                            rspvec_alph.print("rspvec_old_alph");
-                            if (nden == 2)
-                                rspvec_beta.print("rspvec_old_beta");
-                        }
+            const size_t nov_tot = rspvecs.n_rows;
+            double max_rmsd = 0.0;
 
-                        if (do_compute_generalized_density) {
-                            // Compute J and K from D.
-                            compute_generalized_density(Dg.slice(0), rspvec_alph, C_occ_alph, C_virt_alph);
-                            if (nden == 2)
-                                compute_generalized_density(Dg.slice(1), rspvec_beta, C_occ_beta, C_virt_beta);
+            for (size_t v = v_begin; v < v_end; v++) {
 
-                            if (print_level >= 10)
-                                pretty_print(Dg, "Dg");
+                const size_t c = active[v];
 
-                            matvec->compute(J, K, Dg);
-                        } else {
-                            // Compute J and K from L and R.
-                            L[0] = C_virt_alph;
-                            arma::mat qm_alph(rspvec_alph.memptr(), nvirt_alph, nocc_alph, false, true);
-                            R[0] = (qm_alph * C_occ_alph.t()).t();
-                            if (nden == 2) {
-                                L[1] = C_virt_beta;
-                                arma::mat qm_beta(rspvec_beta.memptr(), nvirt_beta, nocc_beta, false, true);
-                                R[1] = (qm_beta * C_occ_beta.t()).t();
-                            }
-                            matvec->compute(J, K, L, R);
-                        }
+                rspvecs_old.col(c) = rspvecs.col(c);
 
-                        if (print_level >= 10) {
-                            pretty_print(J, "J");
-                            pretty_print(K, "K");
-                        }
+                const arma::vec product(ws.products.colptr(v), nov_tot, false, true);
+                scoped_timer timer_update(timings, PHASE_NEW_RSPVEC);
+                solvers[c]->update(product);
+                rspvecs.col(c) = solvers[c]->solution();
+                timer_update.stop();
+                components[c].n_iter = iter + 1;
 
-                        form_orbital_hessian_equations(ints_mnov, J, K, hamiltonian, spin, b_prefactor);
+                // Wrappers over vectors.
+                const arma::vec rspvec_alph(rspvecs.colptr(c), nov_alph, false, true);
+                const arma::vec rspvec_old_alph(rspvecs_old.colptr(c), nov_alph, false, true);
+                info.curr_rmsd_alph = rmsd(rspvec_alph, rspvec_old_alph);
 
-                        if (print_level >= 10)
-                            pretty_print(ints_mnov, "ints_mnov");
+                bool is_converged = (info.curr_rmsd_alph < conv);
+                max_rmsd = std::max(max_rmsd, info.curr_rmsd_alph);
 
-                        AO2MO(ints_ovov_alph, ints_mnov.slice(0), C_virt_alph, C_occ_alph);
-                        if (nden == 2)
-                            AO2MO(ints_ovov_beta, ints_mnov.slice(1), C_virt_beta, C_occ_beta);
+                if (nden == 2) {
+                    const arma::vec rspvec_beta(rspvecs.colptr(c) + nov_alph, nov_beta, false, true);
+                    const arma::vec rspvec_old_beta(rspvecs_old.colptr(c) + nov_alph, nov_beta, false, true);
+                    info.curr_rmsd_beta = rmsd(rspvec_beta, rspvec_old_beta);
 
-                        repack_matrix_to_vector(product_alph, ints_ovov_alph);
-                        if (nden == 2)
-                            repack_matrix_to_vector(product_beta, ints_ovov_beta);
+                    is_converged = is_converged && (info.curr_rmsd_beta < conv);
+                    max_rmsd = std::max(max_rmsd, info.curr_rmsd_beta);
+                }
 
-                        if (print_level >= 10) {
-                            product_alph.print("product_alph");
-                            if (nden == 2)
-                                product_beta.print("product_beta");
-                        }
+                // The residual covers both spins at once, since they
+                // are coupled.
+                if (settings.convergence == CONVERGENCE_RESIDUAL) {
+                    info.curr_residual = solvers[c]->residual_norm();
+                    is_converged = (info.curr_residual < conv_residual);
+                }
 
-                        form_new_rspvec(rspvec_alph, product_alph, rhsvec_alph, *ediff_alph, frequency);
-                        if (nden == 2)
-                            form_new_rspvec(rspvec_beta, product_beta, rhsvec_beta, *ediff_beta, frequency);
+                // Single-precision products can't confirm
+                // convergence.
+                is_converged = is_converged && !single;
+
+                if (print_level >= 10)
+                    rspvecs.col(c).print("rspvec");
+
+                // Compute and check for convergence.
+                info.iter = iter + 1;
+                // Within a block, number the vectors across all
+                // operators rather than within one operator.
+                info.s = is_block ? (c + 1) : (components[c].s + 1);
+                if (print_level >= 2)
+                    std::cout << info << std::endl;
+
+                if (is_converged) {
+                    components[c].is_converged = true;
+                    scatter_component(c);
+                } else {
+                    still_active.push_back(c);
+                }
 
-                        if (print_level >= 10) {
-                            rspvec_alph.print("rspvec_alph");
-                            if (nden == 2)
-                                rspvec_beta.print("rspvec_beta");
-                        }
+            }
 
-                        // Compute and check for convergence.
-                        info.curr_rmsd_alph = rmsd(rspvec_alph, rspvec_old_alph);
-                        if (nden == 2) {
-                            info.curr_rmsd_beta = rmsd(rspvec_beta, rspvec_old_beta);
+            return max_rmsd;
+
+        }
+
+    /*!
+     * Iterate the given components together until all of them have
+     * converged. Each iteration makes one call to the J/K engine for
+     * every component that is still active (or, with the async
+     * pipeline, one per batch of them); converged components are
+     * retired from the block immediately.
+     *
+     * @param[in] &indices indices into components to converge
+     */
+    void iterate(const std::vector<size_t> &indices)
+        {
+
+            iteration_info_linear info;
+            info.has_beta = (nden == 2);
+            info.max_rmsd_alph = 0.0;
+            info.max_rmsd_beta = 0.0;
+            info.has_residual = (settings.convergence == CONVERGENCE_RESIDUAL);
+            info.curr_residual = 0.0;
+
+            const size_t nov_tot = rspvecs.n_rows;
+            const bool is_block = (indices.size() > 1);
+
+            std::vector<size_t> active(indices);
+            std::vector<size_t> still_active;
+            std::vector<int> b_prefactors;
+            still_active.reserve(active.size());
+            b_prefactors.reserve(active.size());
+
+            // Components iterated together always share an
+            // iteration count, which is only nonzero when resuming.
+            const size_t iter_start = active.empty() ? 0 : components[active[0]].n_iter;
+
+            // With mixed precision, start with single-precision J/K
+            // and switch once the whole block has settled down.
+            bool single = settings.mixed_precision;
+
+            // A checkpoint to write during the next iteration's first
+            // build, with the async pipeline.
+            bool checkpoint_pending = false;
+
+            // The pipeline's two sections are a parallel region, so
+            // the J/K engine and the host loops inside them only get
+            // their threads with nested parallelism.
+            const scoped_max_active_levels levels(settings.async_pipeline ? 2 : 0);
+
+            for (size_t iter = iter_start; iter < maxiter && !active.empty(); iter++) {
+
+                const size_t nactive = active.size();
+                conv_residual = residual_threshold();
+                arma::mat vecs(ws.vecs.memptr(), nov_tot, nactive, false, true);
+                arma::mat products(ws.products.memptr(), nov_tot, nactive, false, true);
+                b_prefactors.resize(nactive);
+                for (size_t v = 0; v < nactive; v++) {
+                    vecs.col(v) = solvers[active[v]]->trial();
+                    b_prefactors[v] = components[active[v]].b_prefactor;
+                }
+
+                if (print_level >= 10)
+                    vecs.print("trial vectors");
+
+                // G is linear, so G x = G x_prev + G (x - x_prev):
+                // only the change is passed to the J/K engine, except
+                // for a periodic full build.
+                if (settings.incremental_fock) {
+                    for (size_t v = 0; v < nactive; v++) {
+                        const size_t c = active[v];
+                        const bool is_full = (fock_age[c] < 0) || (fock_age[c] >= settings.incremental_fock_rebuild);
+                        if (is_full) {
+                            trials_prev.col(c) = vecs.col(v);
+                        } else {
+                            vecs.col(v) -= trials_prev.col(c);
+                            trials_prev.col(c) += vecs.col(v);
                         }
-                        info.iter = iter + 1;
-                        info.s = s + 1;
-                        if (print_level >= 2) {
-                            std::cout << info << std::endl;
-                            // arma::vec diff = rspvec_alph - rspvec_old_alph;
-                            // std::cout << " inf:" << arma::norm(diff, "inf") << std::endl;
-                            // std::cout << "frob:" << arma::norm(diff, "frob") << std::endl;
-                            // std::cout << "   2:" << arma::norm(diff, 2) << std::endl;
-                            // if (nden == 2) {
-                            //     diff = rspvec_alph - rspvec_old_alph;
-                            //     std::cout << " inf:" << arma::norm(diff, "inf") << std::endl;
-                            //     std::cout << "frob:" << arma::norm(diff, "frob") << std::endl;
-                            //     std::cout << "   2:" << arma::norm(diff, 2) << std::endl;
-                            // }
+                    }
+                }
+
+                // Stage s builds the products for batch s while the
+                // solvers for batch s - 1 are updated, and the first
+                // build also overlaps any checkpoint held over from
+                // the previous iteration. Without the pipeline there
+                // is one batch and the stages run in order.
+                const size_t nbatch = settings.async_pipeline ? std::min<size_t>(settings.async_batches, nactive) : 1;
+                still_active.clear();
+                double max_rmsd = 0.0;
+                for (size_t s = 0; s <= nbatch; s++) {
+
+                    const bool do_build = (s < nbatch);
+                    const bool do_update = (s > 0);
+                    const bool do_write = (s == 0) && checkpoint_pending;
+
+                    // Exceptions can't leave the parallel region, so
+                    // the first one is rethrown afterwards.
+                    std::string error;
+#pragma omp parallel sections num_threads(2) if(settings.async_pipeline)
+                    {
+#pragma omp section
+                        {
+                            try {
+                                if (do_build)
+                                    build_products(active, b_prefactors, s * nactive / nbatch, (s + 1) * nactive / nbatch, single);
+                            } catch (const std::exception &e) {
+#pragma omp critical(libresponse_pipeline_error)
+                                error = e.what();
+                            }
                         }
-                        if (info.curr_rmsd_alph < conv) {
-                            if (nden == 1) {
-                                is_converged = true;
-                                break;
-                            } else if (info.curr_rmsd_beta < conv) {
-                                is_converged = true;
-                                break;
+#pragma omp section
+                        {
+                            try {
+                                if (do_update)
+                                    max_rmsd = std::max(max_rmsd, update_components(still_active, info, active, (s - 1) * nactive / nbatch, s * nactive / nbatch, iter, is_block, single));
+                                if (do_write)
+                                    write_restart(true);
+                            } catch (const std::exception &e) {
+#pragma omp critical(libresponse_pipeline_error)
+                                error = e.what();
                             }
                         }
-
-                        rspvec_old_alph = rspvec_alph;
-                        if (nden == 2)
-                            rspvec_old_beta = rspvec_beta;
-
                     }
+                    if (!error.empty())
+                        throw std::runtime_error(error);
 
-                    // If not converged after the maximum number of
-                    // iterations, crash.
-                    if (!is_converged) {
-                        throw std::runtime_error("not converged after " + SSTR(maxiter) + " iterations");
-                    }
+                }
+                checkpoint_pending = false;
+
+                if (print_level >= 10)
+                    products.print("products");
+
+                active.swap(still_active);
+
+                if (single && max_rmsd < settings.mixed_precision_conv) {
+                    single = false;
+                    // Don't build on products that carry single
+                    // precision errors: every active solver starts
+                    // over from its current solution, dropping any
+                    // recurrence, Krylov basis or subspace, and the
+                    // next builds are full ones.
+                    for (size_t v = 0; v < active.size(); v++)
+                        solvers[active[v]]->restart(rspvecs.col(active[v]));
+                    fock_age.assign(fock_age.size(), -1);
+                    if (print_level >= 2)
+                        std::cout << "  Switching to double precision J/K" << std::endl;
+                }
 
+                if (checkpoint_interval > 0 && ((iter + 1) % checkpoint_interval) == 0) {
+                    // The next iteration's first build doesn't touch
+                    // anything that is saved, so the write can wait
+                    // for it.
+                    if (settings.async_pipeline && !active.empty() && (iter + 1) < maxiter)
+                        checkpoint_pending = true;
+                    else
+                        write_restart(true);
                 }
 
             }
 
+            // If not converged after the maximum number of
+            // iterations, crash.
+            if (!active.empty()) {
+                // Leave the current (unconverged) vectors in the
+                // operators so they can be inspected or saved.
+                for (size_t v = 0; v < active.size(); v++)
+                    scatter_component(active[v]);
+                throw std::runtime_error("not converged after " + SSTR(maxiter) + " iterations");
+            }
+
+            return;
+
+        }
+
+    void save_state(checkpoint_writer &chk) const
+        {
+
+            const size_t ncomp = components.size();
+            arma::vec is_converged(ncomp);
+            arma::vec n_iter(ncomp);
+            for (size_t c = 0; c < ncomp; c++) {
+                is_converged(c) = components[c].is_converged;
+                n_iter(c) = components[c].n_iter;
+            }
+
+            chk.add_scalar("frequency", frequency);
+            chk.add("rspvecs", rspvecs);
+            chk.add("rspvecs_old", rspvecs_old);
+            chk.add("components_is_converged", is_converged);
+            chk.add("components_n_iter", n_iter);
+            for (size_t c = 0; c < ncomp; c++)
+                solvers[c]->save_state(chk, "solver_" + SSTR(c) + "_");
+
+            return;
+
+        }
+
+    void load_state(const checkpoint_reader &chk)
+        {
+
+            const size_t ncomp = components.size();
+            const checkpoint_entry &e = chk.entry("rspvecs");
+            if (e.n_rows != rspvecs.n_rows || e.n_cols != ncomp)
+                throw std::runtime_error("restart checkpoint was written for a different system");
+            if (std::abs(chk.load_scalar("frequency") - frequency) > 1.0e-12)
+                throw std::runtime_error("restart checkpoint was written for a different frequency");
+
+            chk.load("rspvecs", rspvecs);
+            chk.load("rspvecs_old", rspvecs_old);
+            arma::mat is_converged, n_iter;
+            chk.load("components_is_converged", is_converged);
+            chk.load("components_n_iter", n_iter);
+            for (size_t c = 0; c < ncomp; c++) {
+                components[c].is_converged = (is_converged(c) != 0.0);
+                components[c].n_iter = static_cast<size_t>(n_iter(c));
+                solvers[c]->load_state(chk, "solver_" + SSTR(c) + "_");
+                // Converged components won't be iterated again, so
+                // their operators need the final vectors now.
+                if (components[c].is_converged)
+                    scatter_component(c);
+            }
+
+            return;
+
+        }
+
+    /*!
+     * After a distributed run, give every rank the response vectors,
+     * iteration counts and convergence of every component, each
+     * taken from the rank that owns it, and copy them into the
+     * operators.
+     *
+     * @param[in] failed did this rank fail
+     * @return did any rank fail
+     */
+    bool share_components(bool failed)
+        {
+
+            const size_t nov_tot = rspvecs.n_rows;
+            const size_t ncomp = components.size();
+
+            // Every other rank contributes zeros, so one sum is a
+            // gather to everyone.
+            arma::vec buf(nov_tot * ncomp + 2 * ncomp + 1, arma::fill::zeros);
+            for (size_t c = 0; c < ncomp; c++) {
+                if (!comm->owns(c))
+                    continue;
+                buf.subvec(c * nov_tot, (c + 1) * nov_tot - 1) = rspvecs.col(c);
+                buf(nov_tot * ncomp + c) = components[c].n_iter;
+                buf(nov_tot * ncomp + ncomp + c) = components[c].is_converged ? 1.0 : 0.0;
+            }
+            buf(buf.n_elem - 1) = failed ? 1.0 : 0.0;
+
+            comm->allreduce_sum(buf.memptr(), buf.n_elem);
+
+            for (size_t c = 0; c < ncomp; c++) {
+                rspvecs.col(c) = buf.subvec(c * nov_tot, (c + 1) * nov_tot - 1);
+                components[c].n_iter = static_cast<size_t>(buf(nov_tot * ncomp + c));
+                components[c].is_converged = (buf(nov_tot * ncomp + ncomp + c) != 0.0);
+                scatter_component(c);
+            }
+
+            return buf(buf.n_elem - 1) != 0.0;
+
+        }
+
+    /*!
+     * Add the iteration count of every component at this frequency
+     * to the timing summary.
+     */
+    void record_iterations() const
+        {
+
+            if (timings == NULL)
+                return;
+
+            for (size_t c = 0; c < components.size(); c++) {
+                iteration_record r;
+                r.frequency_index = frequency_index;
+                r.operator_index = components[c].i;
+                r.component = components[c].s;
+                r.iterations = components[c].n_iter;
+                r.converged = components[c].is_converged;
+                timings->iterations.push_back(r);
+            }
+
+            return;
+
+        }
+
+public:
+
+    SolverIterator_linear() : conv_residual(0.0) { }
+    ~SolverIterator_linear() { clear_solvers(); }
+
+    void reset() { clear_solvers(); }
+
+    void run() {
+
+        gather_components();
+
+        if (restart_source != NULL) {
+            load_state(*restart_source);
+            restart_source = NULL;
+        }
+
+        // Either converge every (operator, component) pair together
+        // in one block, where each iteration makes a single batched
+        // J/K call, or loop over operators, then components of that
+        // operator, converging each one separately.
+        const bool do_block = settings.solver_block;
+
+        // When distributed, each rank only converges its own
+        // components (its block is just those), and the vectors are
+        // shared at the end. A failure on one rank can't skip the
+        // collective, so it is held until afterwards.
+        const bool distribute = (comm != NULL) && (comm->size() > 1) && (settings.distribute == DISTRIBUTE_COMPONENTS);
+
+        std::string error;
+        try {
+            if (do_block) {
+                std::vector<size_t> indices;
+                for (size_t c = 0; c < components.size(); c++) {
+                    if (components[c].is_converged || (distribute && !comm->owns(c)))
+                        continue;
+                    indices.push_back(c);
+                    if (print_level >= 2) {
+                        std::cout << "  vec: " << c + 1;
+                        print_component_header(c);
+                    }
+                }
+                if (!indices.empty())
+                    iterate(indices);
+            } else {
+                std::vector<size_t> indices(1);
+                for (size_t c = 0; c < components.size(); c++) {
+                    if (components[c].is_converged || (distribute && !comm->owns(c)))
+                        continue;
+                    if (print_level >= 2)
+                        print_component_header(c);
+                    indices[0] = c;
+                    iterate(indices);
+                }
+            }
+        } catch (const std::exception &e) {
+            if (!distribute) {
+                record_iterations();
+                throw;
+            }
+            error = e.what();
         }
 
+        bool failed = !error.empty();
+        if (distribute)
+            failed = share_components(failed);
+
+        record_iterations();
+
+        if (failed)
+            throw std::runtime_error(error.empty() ? "not converged on another rank" : error);
+
         return;
 
     }
 
 };
 
-class SolverIterator_nonorthogonal : public SolverIterator_i<arma::mat> {
+class SolverIterator_nonorthogonal : public SolverIterator_i<ediff_nonorthogonal> {
 
 protected:
 
@@ -391,14 +1226,96 @@ public:
 
 class SolverIterator_ALMO_linear : public SolverIterator_nonorthogonal {
 
+protected:
+
+    // Intermediates for a single (alpha, beta) trial vector, sized at
+    // the start of each run().
+
+    // Hold the generalized density (the response vector in the AO
+    // basis) and the resulting J/K formed from that density.
+    arma::cube Dg;
+    arma::cube J;
+    arma::cube K;
+    // Without Dg, its factors for each spin, Dg = L R^T.
+    std::vector<arma::mat> L;
+    std::vector<arma::mat> R;
+    // These are for the intermediate integrals (2 transformed
+    // indices).
+    arma::cube ints_mnov;
+    // These are for the 4-index transformed integrals; upon
+    // repacking into a vector, these are the matrix-vector
+    // products (see above).
+    arma::mat ints_ovov_alph;
+    arma::mat ints_ovov_beta;
+
+    // Occupied and virtual MO coefficient blocks, sliced out of C
+    // at the start of each run().
+    arma::mat C_occ_alph;
+    arma::mat C_virt_alph;
+    arma::mat C_occ_beta;
+    arma::mat C_virt_beta;
+
+    void allocate_intermediates()
+        {
+
+            const size_t nao = C->n_rows;
+            if (do_compute_generalized_density) {
+                Dg.set_size(nao, nao, nden);
+                L.clear();
+                R.clear();
+            } else {
+                Dg.reset();
+                L.resize(nden);
+                R.resize(nden);
+            }
+            J.set_size(nao, nao, nden);
+            K.set_size(nao, nao, nden);
+            ints_mnov.set_size(nao, nao, nden);
+            ints_ovov_alph.set_size(nvirt_alph, nocc_alph);
+            if (nden == 2)
+                ints_ovov_beta.set_size(nvirt_beta, nocc_beta);
+
+            C_occ_alph = C->slice(0).cols(0, nocc_alph - 1);
+            C_virt_alph = C->slice(0).cols(nocc_alph, nocc_alph + nvirt_alph - 1);
+            if (nden == 2) {
+                C_occ_beta = C->slice(1).cols(0, nocc_beta - 1);
+                C_virt_beta = C->slice(1).cols(nocc_beta, nocc_beta + nvirt_beta - 1);
+            }
+
+            return;
+
+        }
+
+    // As SolverIterator_linear::residual_threshold, over the vectors
+    // held by the operators.
+    double residual_threshold() const
+        {
+
+            if (settings.conv_property <= 0.0)
+                return conv;
+
+            double norm_max = 0.0;
+            for (size_t i = 0; i < operators->size(); i++) {
+                const operator_spec &os = operators->at(i);
+                if (!os.do_response)
+                    continue;
+                for (size_t s = 0; s < os.ncomp; s++) {
+                    double norm_sq = arma::dot(os.rspvecs_alph.col(s), os.rspvecs_alph.col(s));
+                    if (nden == 2)
+                        norm_sq += arma::dot(os.rspvecs_beta.col(s), os.rspvecs_beta.col(s));
+                    norm_max = std::max(norm_max, std::sqrt(norm_sq));
+                }
+            }
+
+            return (norm_max > 0.0) ? (settings.conv_property / norm_max) : conv;
+
+        }
+
 public:
 
     void run() {
 
-        arma::cube Dg_masked;
-        arma::cube J_masked;
-        arma::cube K_masked;
-        arma::cube ints_mnov_masked;
+        allocate_intermediates();
 
         const arma::uvec nbasis_frgm = fragment_occupations.col(0);
         const arma::uvec norb_frgm = fragment_occupations.col(1);
@@ -407,9 +1324,12 @@ public:
         const arma::uvec nvirt_frgm_alph = norb_frgm - nocc_frgm_alph;
         const arma::uvec nvirt_frgm_beta = norb_frgm - nocc_frgm_beta;
 
-        const type::indices indices_ao = make_indices_ao(nbasis_frgm);
+        // The AO masks keep only the diagonal fragment blocks, which
+        // are stored (and masked) in place without full-size
+        // temporaries.
+        fragment_block_mat ao_blocks(make_indices_ao(nbasis_frgm));
         arma::uvec indices_mo_alph, indices_mo_beta;
-        const int frgm_response_idx = cfg->get_param<int>("_frgm_response_idx");
+        const int frgm_response_idx = settings.frgm_response_idx;
         if (frgm_response_idx > 0) {
             const type::indices indices_mo_allfrgm_alph = make_indices_mo_restricted_local_occ_all_virt(nocc_frgm_alph, nvirt_frgm_alph);
             const type::indices indices_mo_allfrgm_beta = make_indices_mo_restricted_local_occ_all_virt(nocc_frgm_beta, nvirt_frgm_beta);
@@ -420,13 +1340,21 @@ public:
             indices_mo_beta = make_indices_mo_restricted(nocc_frgm_beta, nvirt_frgm_beta);
         }
 
+        // The MO masks zero the excluded (ia) pairs in place.
+        const arma::uvec excluded_mo_alph = complement_indices(indices_mo_alph, nov_alph);
+        arma::uvec excluded_mo_beta;
+        if (nden == 2)
+            excluded_mo_beta = complement_indices(indices_mo_beta, nov_beta);
+
         arma::uvec indices_mo_red_alph, indices_mo_red_beta;
         size_t nred_alph, nred_beta;
         arma::vec rhsvec_reduced_alph, rhsvec_reduced_beta;
         arma::vec product_reduced_alph, product_reduced_beta;
         arma::vec rspvec_reduced_alph, rspvec_reduced_beta;
+        arma::vec residual_alph, residual_beta;
 
-        const bool reduce = cfg->get_param<bool>("_mask_ediff_mo");
+        const bool reduce = settings.mask_ediff_mo;
+        const bool check_residual = (settings.convergence == CONVERGENCE_RESIDUAL);
         if (reduce) {
             nred_alph = indices_mo_alph.n_elem;
             indices_mo_red_alph = range(nred_alph);
@@ -447,7 +1375,7 @@ public:
         std::vector< arma::mat > rspvecs_old_alph;
         for (size_t i = 0; i < operators->size(); i++) {
             if (operators->at(i).do_response)
-                rspvecs_old_alph.push_back(arma::mat(nov_alph, operators->at(i).integrals_ao.n_slices));
+                rspvecs_old_alph.push_back(arma::mat(nov_alph, operators->at(i).ncomp));
         }
         std::vector< arma::mat > rspvecs_old_beta;
         // These are for the matrix-vector products between the
@@ -456,14 +1384,14 @@ public:
         std::vector< arma::mat > products_alph;
         for (size_t i = 0; i < operators->size(); i++) {
             if (operators->at(i).do_response)
-                products_alph.push_back(arma::mat(nov_alph, operators->at(i).integrals_ao.n_slices, arma::fill::zeros));
+                products_alph.push_back(arma::mat(nov_alph, operators->at(i).ncomp, arma::fill::zeros));
         }
         std::vector< arma::mat > products_beta;
         if (nden == 2) {
             for (size_t i = 0; i < operators->size(); i++) {
                 if (operators->at(i).do_response) {
-                    rspvecs_old_beta.push_back(arma::mat(nov_beta, operators->at(i).integrals_ao.n_slices));
-                    products_beta.push_back(arma::mat(nov_beta, operators->at(i).integrals_ao.n_slices, arma::fill::zeros));
+                    rspvecs_old_beta.push_back(arma::mat(nov_beta, operators->at(i).ncomp));
+                    products_beta.push_back(arma::mat(nov_beta, operators->at(i).ncomp, arma::fill::zeros));
                 }
             }
         }
@@ -473,17 +1401,8 @@ public:
             info.has_beta = false;
         else
             info.has_beta = true;
-
-        const std::string hamiltonian = cfg->get_param("hamiltonian");
-        const std::string spin = cfg->get_param("spin");
-        arma::mat C_occ_alph = C->slice(0).cols(0, nocc_alph - 1);
-        arma::mat C_virt_alph = C->slice(0).cols(nocc_alph, nocc_alph + nvirt_alph - 1);
-        arma::mat C_occ_beta;
-        arma::mat C_virt_beta;
-        if (nden == 2) {
-            C_occ_beta = C->slice(1).cols(0, nocc_beta - 1);
-            C_virt_beta = C->slice(1).cols(nocc_beta, nocc_beta + nvirt_beta - 1);
-        }
+        info.has_residual = check_residual;
+        info.curr_residual = 0.0;
 
         // Perform the linear CPSCF iterations. Loop over operators,
         // then components of that operator, converging each one
@@ -494,7 +1413,7 @@ public:
 
                 const int b_prefactor = operators->at(i).b_prefactor;
 
-                for (size_t s = 0; s < operators->at(i).integrals_ao.n_slices; s++) {
+                for (size_t s = 0; s < operators->at(i).ncomp; s++) {
 
                     bool is_converged = false;
 
@@ -538,6 +1457,11 @@ public:
                     // Perform the response vector update.
                     info.max_rmsd_alph = 0.0;
                     info.max_rmsd_beta = 0.0;
+                    info.iter = 0;
+
+                    // As for SolverIterator_linear, from the current
+                    // vectors (converged or the initial guess).
+                    const double conv_residual = residual_threshold();
                     for (size_t iter = 0; iter < maxiter; iter++) {
 
                         if (print_level >= 10) {
@@ -548,32 +1472,39 @@ public:
 
                         if (do_compute_generalized_density) {
                             // Compute J and K from D.
+                            scoped_timer timer_density(timings, PHASE_DENSITY);
                             compute_generalized_density(Dg.slice(0), rspvec_alph, C_occ_alph, C_virt_alph);
                             if (nden == 2)
                                 compute_generalized_density(Dg.slice(1), rspvec_beta, C_occ_beta, C_virt_beta);
+                            timer_density.stop();
 
                             if (print_level >= 10)
                                 pretty_print(Dg, "Dg");
 
-                            if (cfg->get_param<bool>("_mask_dg_ao")) {
-                                make_masked_cube(Dg_masked, Dg, indices_ao, 0.0);
-                                Dg = Dg_masked;
+                            if (settings.mask_dg_ao) {
+                                const scoped_timer timer_mask(timings, PHASE_MASKING);
+                                ao_blocks.mask(Dg);
                                 if (print_level >= 10)
                                     pretty_print(Dg, "Dg (masked)");
                             }
 
+                            const scoped_timer timer_jk(timings, PHASE_JK);
                             matvec->compute(J, K, Dg);
                         } else {
-                            // Compute J and K from L and R.
+                            // Compute J and K from L and R, factored
+                            // with the occupied rank.
                             // TODO implement index masking for L and R?
-                            L[0] = C_virt_alph;
+                            scoped_timer timer_density(timings, PHASE_DENSITY);
                             arma::mat qm_alph(rspvec_alph.memptr(), nvirt_alph, nocc_alph, false, true);
-                            R[0] = (qm_alph * C_occ_alph.t()).t();
+                            L[0] = C_virt_alph * qm_alph;
+                            R[0] = C_occ_alph;
                             if (nden == 2) {
-                                L[1] = C_virt_beta;
                                 arma::mat qm_beta(rspvec_beta.memptr(), nvirt_beta, nocc_beta, false, true);
-                                R[1] = (qm_beta * C_occ_beta.t()).t();
+                                L[1] = C_virt_beta * qm_beta;
+                                R[1] = C_occ_beta;
                             }
+                            timer_density.stop();
+                            const scoped_timer timer_jk(timings, PHASE_JK);
                             matvec->compute(J, K, L, R);
                         }
 
@@ -582,41 +1513,56 @@ public:
                             pretty_print(K, "K");
                         }
 
-                        if (cfg->get_param<bool>("_mask_j_ao")) {
-                            make_masked_cube(J_masked, J, indices_ao, 0.0);
-                            J = J_masked;
+                        scoped_timer timer_mask(timings, PHASE_MASKING);
+                        if (settings.mask_j_ao) {
+                            ao_blocks.mask(J);
                             if (print_level >= 10)
                                 pretty_print(J, "J (masked)");
                         }
-                        if (cfg->get_param<bool>("_mask_k_ao")) {
-                            make_masked_cube(K_masked, K, indices_ao, 0.0);
-                            K = K_masked;
+                        if (settings.mask_k_ao) {
+                            ao_blocks.mask(K);
                             if (print_level >= 10)
                                 pretty_print(K, "K (masked)");
                         }
 
-                        form_orbital_hessian_equations(ints_mnov, J, K, hamiltonian, spin, b_prefactor);
+                        timer_mask.stop();
+
+                        scoped_timer timer_hessian(timings, PHASE_HESSIAN);
+                        form_orbital_hessian_equations(ints_mnov, J, K, settings.hamiltonian, settings.spin, b_prefactor);
+                        timer_hessian.stop();
 
                         if (print_level >= 10)
                             pretty_print(ints_mnov, "ints_mnov");
 
-                        if (cfg->get_param<bool>("_mask_ints_mnov_ao")) {
-                            make_masked_cube(ints_mnov_masked, ints_mnov, indices_ao, 0.0);
-                            ints_mnov = ints_mnov_masked;
-                            if (print_level >= 10)
-                                pretty_print(ints_mnov, "ints_mnov (masked)");
-                        }
-
                         // There's no mask call for ints_ovov_spin since
                         // they get repacked into (product) vectors which
                         // can then be masked.
-                        AO2MO(ints_ovov_alph, ints_mnov.slice(0), C_virt_alph, C_occ_alph);
-                        if (nden == 2)
-                            AO2MO(ints_ovov_beta, ints_mnov.slice(1), C_virt_beta, C_occ_beta);
+                        scoped_timer timer_ao2mo(timings, PHASE_AO2MO);
+                        if (settings.mask_ints_mnov_ao) {
+                            // Transform straight from the fragment
+                            // blocks, one small GEMM pair per fragment.
+                            ao_blocks.gather(ints_mnov.slice(0));
+                            ao_blocks.transform(ints_ovov_alph, C_virt_alph, C_occ_alph);
+                            if (print_level >= 10)
+                                ao_blocks.scatter(ints_mnov.slice(0));
+                            if (nden == 2) {
+                                ao_blocks.gather(ints_mnov.slice(1));
+                                ao_blocks.transform(ints_ovov_beta, C_virt_beta, C_occ_beta);
+                                if (print_level >= 10)
+                                    ao_blocks.scatter(ints_mnov.slice(1));
+                            }
+                            if (print_level >= 10)
+                                pretty_print(ints_mnov, "ints_mnov (masked)");
+                        } else {
+                            AO2MO(ints_ovov_alph, ints_mnov.slice(0), C_virt_alph, C_occ_alph);
+                            if (nden == 2)
+                                AO2MO(ints_ovov_beta, ints_mnov.slice(1), C_virt_beta, C_occ_beta);
+                        }
 
                         repack_matrix_to_vector(product_alph, ints_ovov_alph);
                         if (nden == 2)
                             repack_matrix_to_vector(product_beta, ints_ovov_beta);
+                        timer_ao2mo.stop();
 
                         if (print_level >= 10) {
                             product_alph.print("product_alph");
@@ -624,21 +1570,18 @@ public:
                                 product_beta.print("product_beta");
                         }
 
-                        if (cfg->get_param<bool>("_mask_product_mo")) {
-                            arma::vec product_masked_alph(product_alph.n_elem, arma::fill::zeros);
-                            product_masked_alph(indices_mo_alph) = product_alph(indices_mo_alph);
-                            product_alph = product_masked_alph;
+                        if (settings.mask_product_mo) {
+                            product_alph(excluded_mo_alph).zeros();
                             if (print_level >= 10)
                                 product_alph.print("product_alph (masked)");
                             if (nden == 2) {
-                                arma::vec product_masked_beta(product_beta.n_elem, arma::fill::zeros);
-                                product_masked_beta(indices_mo_beta) = product_beta(indices_mo_beta);
-                                product_beta = product_masked_beta;
+                                product_beta(excluded_mo_beta).zeros();
                                 if (print_level >= 10)
                                     product_beta.print("product_beta (masked)");
                             }
                         }
 
+                        scoped_timer timer_update(timings, PHASE_NEW_RSPVEC);
                         if (reduce) {
 
                             // shrink
@@ -652,6 +1595,14 @@ public:
                                 rspvec_reduced_beta = rspvec_beta(indices_mo_beta);
                             }
 
+                            // The residual of the trial vector, before
+                            // it is replaced.
+                            if (check_residual) {
+                                form_residual(residual_alph, rspvec_reduced_alph, product_reduced_alph, rhsvec_reduced_alph, *ediff_alph, frequency);
+                                if (nden == 2)
+                                    form_residual(residual_beta, rspvec_reduced_beta, product_reduced_beta, rhsvec_reduced_beta, *ediff_beta, frequency);
+                            }
+
                             // calculate
                             form_new_rspvec(rspvec_reduced_alph, product_reduced_alph, rhsvec_reduced_alph, *ediff_alph, frequency);
                             if (nden == 2)
@@ -668,11 +1619,25 @@ public:
 
                         } else {
 
+                            if (check_residual) {
+                                form_residual(residual_alph, rspvec_alph, product_alph, rhsvec_alph, *ediff_alph, frequency);
+                                if (nden == 2)
+                                    form_residual(residual_beta, rspvec_beta, product_beta, rhsvec_beta, *ediff_beta, frequency);
+                                // Only the pairs the solution is
+                                // allowed to have can be converged.
+                                if (settings.mask_rspvec_mo) {
+                                    residual_alph(excluded_mo_alph).zeros();
+                                    if (nden == 2)
+                                        residual_beta(excluded_mo_beta).zeros();
+                                }
+                            }
+
                             form_new_rspvec(rspvec_alph, product_alph, rhsvec_alph, *ediff_alph, frequency);
                             if (nden == 2)
                                 form_new_rspvec(rspvec_beta, product_beta, rhsvec_beta, *ediff_beta, frequency);
 
                         }
+                        timer_update.stop();
 
                         if (print_level >= 10) {
                             rspvec_alph.print("rspvec_alph");
@@ -680,15 +1645,10 @@ public:
                                 rspvec_beta.print("rspvec_beta");
                         }
 
-                        if (cfg->get_param<bool>("_mask_rspvec_mo")) {
-                            arma::vec rspvec_masked_alph(rspvec_alph.n_elem, arma::fill::zeros);
-                            rspvec_masked_alph(indices_mo_alph) = rspvec_alph(indices_mo_alph);
-                            rspvec_alph = rspvec_masked_alph;
-                            if (nden == 2) {
-                                arma::vec rspvec_masked_beta(rspvec_beta.n_elem, arma::fill::zeros);
-                                rspvec_masked_beta(indices_mo_beta) = rspvec_beta(indices_mo_beta);
-                                rspvec_beta = rspvec_masked_beta;
-                            }
+                        if (settings.mask_rspvec_mo) {
+                            rspvec_alph(excluded_mo_alph).zeros();
+                            if (nden == 2)
+                                rspvec_beta(excluded_mo_beta).zeros();
                             if (print_level >= 10) {
                                 rspvec_alph.print("rspvec_alph (masked)");
                                 if (nden == 2)
@@ -701,12 +1661,23 @@ public:
                         if (nden == 2) {
                             info.curr_rmsd_beta = rmsd(rspvec_beta, rspvec_old_beta);
                         }
+                        if (check_residual) {
+                            double residual_sq = arma::dot(residual_alph, residual_alph);
+                            if (nden == 2)
+                                residual_sq += arma::dot(residual_beta, residual_beta);
+                            info.curr_residual = std::sqrt(residual_sq);
+                        }
                         info.iter = iter + 1;
                         info.s = s + 1;
                         if (print_level >= 2) {
                             std::cout << info << std::endl;
                         }
-                        if (info.curr_rmsd_alph < conv) {
+                        if (check_residual) {
+                            if (info.curr_residual < conv_residual) {
+                                is_converged = true;
+                                break;
+                            }
+                        } else if (info.curr_rmsd_alph < conv) {
                             if (nden == 1) {
                                 is_converged = true;
                                 break;
@@ -722,6 +1693,16 @@ public:
 
                     }
 
+                    if (timings != NULL) {
+                        iteration_record r;
+                        r.frequency_index = frequency_index;
+                        r.operator_index = i;
+                        r.component = s;
+                        r.iterations = info.iter;
+                        r.converged = is_converged;
+                        timings->iterations.push_back(r);
+                    }
+
                     // If not converged after the maximum number of
                     // iterations, crash.
                     if (!is_converged) {
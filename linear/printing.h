@@ -11,6 +11,8 @@ struct iteration_info_linear {
     double curr_rmsd_beta;
     double max_rmsd_alph;
     double max_rmsd_beta;
+    bool has_residual;
+    double curr_residual; //!< combined alpha/beta residual norm
 };
 
 std::ostream& operator<<(std::ostream& os, const iteration_info_linear& info);
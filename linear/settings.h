@@ -0,0 +1,142 @@
+#ifndef LIBRESPONSE_LINEAR_SETTINGS_H_
+#define LIBRESPONSE_LINEAR_SETTINGS_H_
+
+/*!
+ * @file
+ *
+ * Typed solver settings, parsed once from a configurable.
+ */
+
+#include <string>
+#include "../configurable.h"
+
+namespace libresponse {
+
+//! Which response function a host computes.
+enum response_order {
+    ORDER_LINEAR,   //!< solve_linear_response
+    ORDER_QUADRATIC //!< solve_quadratic_response
+};
+
+//! Form of the orbital Hessian.
+enum hamiltonian_type {
+    HAMILTONIAN_RPA, //!< full (A+B)/(A-B)
+    HAMILTONIAN_TDA  //!< A matrix only
+};
+
+//! Spin symmetry of the perturbing operators.
+enum spin_type {
+    SPIN_SINGLET,
+    SPIN_TRIPLET
+};
+
+//! Update scheme for each response vector (see solvers.h).
+enum linear_solver_type {
+    SOLVER_JACOBI,
+    SOLVER_DIIS,
+    SOLVER_CG,
+    SOLVER_GMRES,
+    SOLVER_SUBSPACE
+};
+
+//! What the convergence threshold is compared against.
+enum convergence_type {
+    CONVERGENCE_RMSD,    //!< RMSD between successive response vectors
+    CONVERGENCE_RESIDUAL //!< norm of the residual of the linear equations
+};
+
+//! How trial densities are passed to the J/K engine.
+enum density_form_type {
+    DENSITY_FORM_AUTO,    //!< factored if the engine prefers_factored_densities(), otherwise dense
+    DENSITY_FORM_DENSE,   //!< the generalized density P
+    DENSITY_FORM_FACTORED //!< its factors L = C_virt X and R = C_occ
+};
+
+//! What is split across ranks for a distributed solve.
+enum distribute_type {
+    DISTRIBUTE_COMPONENTS, //!< operator components, every rank does every frequency
+    DISTRIBUTE_FREQUENCIES //!< frequencies, every rank does every component
+};
+
+//! Where the operators' MO-basis vectors are kept during a solve.
+enum vector_store_type {
+    VECTOR_STORE_NONE,   //!< in the operators' own matrices
+    VECTOR_STORE_MEMORY, //!< a separate vector_store on the heap
+    VECTOR_STORE_DISK    //!< a vector_store mapped from a scratch file
+};
+
+std::string to_string(response_order order);
+std::string to_string(hamiltonian_type hamiltonian);
+std::string to_string(spin_type spin);
+std::string to_string(linear_solver_type solver);
+std::string to_string(convergence_type convergence);
+std::string to_string(density_form_type density_form);
+std::string to_string(distribute_type distribute);
+std::string to_string(vector_store_type store);
+
+/*!
+ * The options the iterators and helpers need while solving, parsed
+ * and validated once so nothing is looked up (or compared as a
+ * string) inside the iterations.
+ *
+ * Bad values throw std::runtime_error when the settings are built,
+ * rather than part way through a solve.
+ */
+struct solver_settings {
+
+    response_order order;
+    hamiltonian_type hamiltonian;
+    spin_type spin;
+
+    linear_solver_type solver;
+    size_t diis_start;       //!< first iteration to extrapolate on
+    size_t diis_vectors;     //!< maximum DIIS subspace size
+    size_t gmres_restart;    //!< maximum Krylov subspace size before restarting
+    size_t subspace_vectors; //!< maximum subspace size before collapsing
+
+    convergence_type convergence;
+    double conv_property; //!< target error in the results, 0 to use conv instead
+
+    int print_level;
+    std::string prefix;
+    int checkpoint_interval;
+    bool solver_block;
+    bool incremental_fock;
+    int incremental_fock_rebuild;
+    bool mixed_precision;
+    double mixed_precision_conv; //!< RMSD below which to switch to double precision
+    bool async_pipeline;
+    int async_batches;
+    distribute_type distribute;
+    vector_store_type store;
+    bool store_compress;
+    bool frequency_sweep;
+    density_form_type density_form;
+
+    // Debugging masks for the nonorthogonal (ALMO) solver.
+    int frgm_response_idx;
+    bool mask_dg_ao;
+    bool mask_j_ao;
+    bool mask_k_ao;
+    bool mask_ints_mnov_ao;
+    bool mask_product_mo;
+    bool mask_rspvec_mo;
+    bool mask_ediff_mo;
+
+    solver_settings();
+
+    /*!
+     * @param[in] &cfg options, with at least the defaults from set_defaults
+     */
+    explicit solver_settings(const configurable &cfg);
+
+    /*!
+     * (Re)parse all settings from the given options.
+     */
+    void init(const configurable &cfg);
+
+};
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_LINEAR_SETTINGS_H_
@@ -0,0 +1,297 @@
+#ifndef LIBRESPONSE_LINEAR_SOLVERS_H_
+#define LIBRESPONSE_LINEAR_SOLVERS_H_
+
+/*!
+ * @file
+ *
+ * Update schemes for a single response vector: Jacobi, DIIS,
+ * preconditioned Krylov (CG, GMRES), and subspace solvers.
+ *
+ * All solvers work on the linear system
+ *
+ * \f$ \left[ (\Delta - \omega) + \mathbf{G} \right] \mathbf{x} = \mathbf{b} \f$
+ *
+ * where \f$ \Delta \f$ is the diagonal of MO energy differences,
+ * \f$ \mathbf{G} \f$ is the two-electron part of the orbital
+ * Hessian (the "product" formed from J and K), and \f$ \mathbf{b}
+ * \f$ is the RHS/gradient vector. The diagonal \f$ (\Delta -
+ * \omega) \f$ is always used as the preconditioner.
+ *
+ * The caller owns the application of \f$ \mathbf{G} \f$, since that
+ * requires the J/K engine: it asks each solver for a trial vector,
+ * forms the product for it, and passes the product back.
+ */
+
+#include <armadillo>
+#include <string>
+#include <vector>
+#include "../checkpoint.h"
+#include "settings.h"
+
+namespace libresponse {
+
+/*!
+ * Solver for a single (combined alpha/beta) response vector: base
+ * class.
+ */
+class LinearSolver_i {
+
+protected:
+
+    arma::vec x;      //!< current solution estimate
+    arma::vec b;      //!< RHS vector
+    arma::vec precon; //!< diagonal preconditioner \f$ (\Delta - \omega) \f$
+    double residual;  //!< see residual_norm()
+
+public:
+
+    LinearSolver_i() : residual(0.0) { }
+    virtual ~LinearSolver_i() { }
+
+    /*!
+     * Start a new solve.
+     *
+     * @param[in] &x0 initial guess
+     * @param[in] &b_ RHS vector
+     * @param[in] &precon_ diagonal preconditioner (energy differences minus frequency)
+     */
+    virtual void init(const arma::vec &x0, const arma::vec &b_, const arma::vec &precon_);
+
+    /*!
+     * Start over from x0 with the same RHS and preconditioner,
+     * dropping everything built from earlier products (including a
+     * subspace kept between frequencies).
+     *
+     * @param[in] &x0 new initial guess
+     */
+    virtual void restart(const arma::vec &x0);
+
+    /*!
+     * The vector that the two-electron part of the orbital Hessian
+     * should be applied to next.
+     */
+    virtual const arma::vec &trial() const = 0;
+
+    /*!
+     * Advance the solver given the product of the two-electron part
+     * of the orbital Hessian with the current trial vector.
+     *
+     * @param[in] &product \f$ \mathbf{G} \f$ times trial()
+     */
+    virtual void update(const arma::vec &product) = 0;
+
+    /*!
+     * The current solution estimate.
+     */
+    const arma::vec &solution() const { return x; }
+
+    /*!
+     * \f$ \| \mathbf{b} - [(\Delta - \omega) + \mathbf{G}]
+     * \mathbf{x} \|_{2} \f$ for the latest iterate the last update
+     * gave a residual for: the trial vector for Jacobi and DIIS (so
+     * the new solution is a step further on), and the solution
+     * itself for the Krylov and subspace solvers. Before the first
+     * update, and for CG and GMRES after it (when the solution is a
+     * provisional Jacobi step whose residual isn't known), it is the
+     * largest double.
+     */
+    double residual_norm() const { return residual; }
+
+    /*!
+     * Write everything needed to continue the solve to a restart
+     * checkpoint, with each entry name starting with prefix.
+     */
+    virtual void save_state(checkpoint_writer &chk, const std::string &prefix) const;
+
+    /*!
+     * Continue a solve from a restart checkpoint. init() must have
+     * been called first with the same RHS and preconditioner.
+     */
+    virtual void load_state(const checkpoint_reader &chk, const std::string &prefix);
+
+};
+
+/*!
+ * Fixed-point (Jacobi) iteration, \f$ \mathbf{x} \leftarrow
+ * (\mathbf{b} - \mathbf{G}\mathbf{x}) / (\Delta - \omega) \f$.
+ */
+class LinearSolver_jacobi : public LinearSolver_i {
+
+public:
+
+    const arma::vec &trial() const { return x; }
+    void update(const arma::vec &product);
+
+};
+
+/*!
+ * Jacobi iteration accelerated by Pulay's DIIS, using the change
+ * in the response vector (the preconditioned residual) as the error
+ * vector.
+ */
+class LinearSolver_diis : public LinearSolver_i {
+
+protected:
+
+    size_t diis_start;   //!< first iteration to extrapolate on
+    size_t diis_vectors; //!< maximum size of the subspace
+    size_t iter;
+
+    std::vector<arma::vec> vecs;
+    std::vector<arma::vec> errs;
+
+public:
+
+    LinearSolver_diis(size_t diis_start_, size_t diis_vectors_)
+        : diis_start(diis_start_)
+        , diis_vectors(diis_vectors_)
+        , iter(0)
+        { }
+
+    void init(const arma::vec &x0, const arma::vec &b_, const arma::vec &precon_);
+    const arma::vec &trial() const { return x; }
+    void update(const arma::vec &product);
+    void save_state(checkpoint_writer &chk, const std::string &prefix) const;
+    void load_state(const checkpoint_reader &chk, const std::string &prefix);
+
+};
+
+/*!
+ * Preconditioned conjugate gradient.
+ *
+ * Only valid when the full orbital Hessian is symmetric positive
+ * definite, which is the case for static (\f$ \omega = 0 \f$) RPA or
+ * TDA response from a stable reference.
+ */
+class LinearSolver_cg : public LinearSolver_i {
+
+protected:
+
+    arma::vec x_base; //!< last true CG iterate
+    arma::vec r;      //!< residual
+    arma::vec z;      //!< preconditioned residual
+    arma::vec p;      //!< search direction
+    arma::vec Ap;     //!< workspace for the full Hessian times p
+    double rz;
+    bool has_residual;
+
+public:
+
+    void init(const arma::vec &x0, const arma::vec &b_, const arma::vec &precon_);
+    const arma::vec &trial() const { return has_residual ? p : x; }
+    void update(const arma::vec &product);
+    void save_state(checkpoint_writer &chk, const std::string &prefix) const;
+    void load_state(const checkpoint_reader &chk, const std::string &prefix);
+
+};
+
+/*!
+ * Restarted, right-preconditioned GMRES.
+ *
+ * Does not require the orbital Hessian to be definite, so it is the
+ * appropriate choice for frequencies close to a pole.
+ */
+class LinearSolver_gmres : public LinearSolver_i {
+
+protected:
+
+    size_t restart;         //!< maximum Krylov subspace size before restarting
+    arma::vec x_base;       //!< solution at the start of the current cycle
+    arma::vec r_base;       //!< residual at the start of the current cycle
+    std::vector<arma::vec> V; //!< orthonormal Krylov basis
+    arma::mat H;            //!< Hessenberg matrix
+    arma::vec cs;           //!< Givens rotation cosines
+    arma::vec sn;           //!< Givens rotation sines
+    arma::vec g;            //!< rotated residual vector
+    arma::vec z;            //!< preconditioned trial vector
+    arma::vec w;            //!< workspace for the new Arnoldi vector
+    arma::vec dv;           //!< workspace for the solution update
+    size_t j;               //!< current position within the cycle
+    bool has_residual;
+    bool is_done;
+
+    /*!
+     * Begin a new cycle from the residual r_base.
+     */
+    void start_cycle();
+
+    /*!
+     * Solve the small least-squares problem for the first n basis
+     * vectors and return the corresponding coefficients.
+     */
+    arma::vec solve_subspace(size_t n) const;
+
+public:
+
+    LinearSolver_gmres(size_t restart_)
+        : restart(restart_)
+        { }
+
+    void init(const arma::vec &x0, const arma::vec &b_, const arma::vec &precon_);
+    const arma::vec &trial() const { return (has_residual && !is_done) ? z : x; }
+    void update(const arma::vec &product);
+    void save_state(checkpoint_writer &chk, const std::string &prefix) const;
+    void load_state(const checkpoint_reader &chk, const std::string &prefix);
+
+};
+
+/*!
+ * Subspace (Davidson-like) solver.
+ *
+ * Keeps an orthonormal set of trial vectors \f$ \mathbf{T} \f$ and
+ * their two-electron products \f$ \mathbf{S} = \mathbf{G}\mathbf{T}
+ * \f$, solves the linear system projected onto that subspace, and
+ * adds the preconditioned residual as the next trial vector.
+ *
+ * Because \f$ \mathbf{S} \f$ does not depend on the frequency, the
+ * subspace is kept when init() is called again for a new frequency,
+ * so the new solution starts from a projected solve that costs no
+ * J/K builds. When the subspace reaches its maximum size, it
+ * collapses onto the current solution.
+ */
+class LinearSolver_subspace : public LinearSolver_i {
+
+protected:
+
+    size_t max_vectors; //!< maximum subspace size before collapsing
+    arma::mat T;        //!< orthonormal trial vectors (each column)
+    arma::mat S;        //!< two-electron products of the trial vectors
+    arma::mat M;        //!< projected full orbital Hessian
+    arma::vec t;        //!< next trial vector
+    bool is_done;
+
+    /*!
+     * Solve the projected equations, form the solution and the next
+     * (orthonormalized) trial vector.
+     */
+    void solve_projected();
+
+public:
+
+    LinearSolver_subspace(size_t max_vectors_)
+        : max_vectors(max_vectors_)
+        { }
+
+    void init(const arma::vec &x0, const arma::vec &b_, const arma::vec &precon_);
+    void restart(const arma::vec &x0);
+    const arma::vec &trial() const { return is_done ? x : t; }
+    void update(const arma::vec &product);
+    void save_state(checkpoint_writer &chk, const std::string &prefix) const;
+    void load_state(const checkpoint_reader &chk, const std::string &prefix);
+
+};
+
+/*!
+ * Create the solver chosen by the "solver" option.
+ *
+ * The caller takes ownership of the returned object.
+ *
+ * @param[in] &settings parsed options (solver, diis_start, diis_vectors, gmres_restart, subspace_vectors)
+ *
+ * @returns newly-allocated solver
+ */
+LinearSolver_i *make_linear_solver(const solver_settings &settings);
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_LINEAR_SOLVERS_H_
@@ -0,0 +1,109 @@
+#ifndef LIBRESPONSE_MATVEC_FACTORED_H_
+#define LIBRESPONSE_MATVEC_FACTORED_H_
+
+/*!
+ * @file
+ *
+ * J/K integral generation from factored (3-index) integrals.
+ */
+
+#include "matvec_i.h"
+
+/*!
+ * J/K integral generation from integrals in factored form,
+ *
+ * \f$ (\mu\nu|\lambda\sigma) \approx \sum_{Q} B_{\mu\nu}^{Q} B_{\lambda\sigma}^{Q} \f$
+ *
+ * such as those from density fitting or a Cholesky decomposition of
+ * the AO integrals. Each \f$ \mathbf{B}^{Q} \f$ must be symmetric.
+ *
+ * J is always \f$ \mathbf{B} (\mathbf{B}^{T} \mathrm{vec}(\mathbf{P})) \f$
+ * with B viewed as [nbasis^2, naux], costing \f$ O(N^{2} N_{aux}) \f$.
+ * For the low-rank L/R path, exchange is built from the
+ * half-transformed integrals \f$ \mathbf{B}^{Q}\mathbf{L} \f$ and \f$
+ * \mathbf{B}^{Q}\mathbf{R} \f$, so P is never formed and K costs \f$
+ * O(N^{2} o N_{aux}) \f$. The half-transformed integrals for a batch
+ * of auxiliary functions are stored side by side, so each batch
+ * contributes to K through a single GEMM; the batch size bounds the
+ * extra memory to \f$ 2 N o N_{batch} \f$ per density.
+ *
+ * Given a dense P instead, K is \f$ \sum_{Q} \mathbf{B}^{Q} \mathbf{P}
+ * \mathbf{B}^{Q} \f$, which costs \f$ O(N^{3} N_{aux}) \f$. This
+ * engine reports prefers_factored_densities(), so the solvers use
+ * the L/R path unless "density_form" is set to "dense" (or an ALMO
+ * AO density mask needs P).
+ */
+class MatVec_factored : public MatVec_i {
+
+public:
+
+    /*!
+     * @param[in] *B_ factored integrals, [nbasis, nbasis, naux], not
+     *            copied, so they must outlive this object
+     * @param[in] batch_size_ number of auxiliary functions per batch
+     *            for K; 0 means all at once
+     */
+    MatVec_factored(const arma::cube *B_, size_t batch_size_ = 64);
+    ~MatVec_factored();
+
+    void compute(arma::cube &J, arma::cube &K, arma::cube &P);
+    void compute(arma::cube &J, arma::cube &K, const std::vector<arma::mat> &L, const std::vector<arma::mat> &R);
+    bool prefers_factored_densities() const;
+
+protected:
+
+    /*!
+     * For derived classes that form (and own) the integrals
+     * themselves; set_integrals must be called before computing.
+     */
+    MatVec_factored(size_t batch_size_);
+
+    void set_integrals(const arma::cube *B_);
+
+private:
+
+    const arma::cube *B;
+    size_t batch_size;
+
+    //! Half-transformed integrals for one batch, [nbasis, rank *
+    //! batch], reused between calls.
+    arma::mat BL;
+    arma::mat BR;
+
+};
+
+/*!
+ * Density-fitted (RI) J/K from the host's 3-index AO integrals \f$
+ * (\mu\nu|P) \f$ and the Coulomb metric \f$ (P|Q) \f$.
+ *
+ * With the Cholesky decomposition \f$ (P|Q) = \mathbf{U}^{T}\mathbf{U}
+ * \f$, the fitted integrals are \f$ \mathbf{B} = (\mu\nu|P)
+ * \mathbf{U}^{-1} \f$, which are formed once here and owned by the
+ * engine, so the host's copies can be freed afterwards. Everything
+ * else is MatVec_factored, including the cost of K: \f$ O(N^{2} o
+ * N_{aux}) \f$ from L/R, which the solvers use by default, and \f$
+ * O(N^{3} N_{aux}) \f$ from a dense P (density_form = dense).
+ */
+class MatVec_DF : public MatVec_factored {
+
+public:
+
+    /*!
+     * @param[in] &ints_3idx \f$ (\mu\nu|P) \f$, [nbasis, nbasis, naux]
+     * @param[in] &metric \f$ (P|Q) \f$, [naux, naux]
+     * @param[in] batch_size_ number of auxiliary functions per batch
+     *            for K; 0 means all at once
+     */
+    MatVec_DF(const arma::cube &ints_3idx, const arma::mat &metric, size_t batch_size_ = 64);
+    ~MatVec_DF();
+
+private:
+
+    arma::cube B_fitted;
+
+    MatVec_DF(const MatVec_DF &);
+    MatVec_DF &operator=(const MatVec_DF &);
+
+};
+
+#endif // LIBRESPONSE_MATVEC_FACTORED_H_
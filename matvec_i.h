@@ -22,12 +22,14 @@ public:
     /*!
      * Compute J and K from P, where P is not necessarily symmetric.
      *
-     * All cubes will either have 1 slice (for restricted
-     * wavefunctions) or 2 slices (for unrestricted wavefunctions).
-     *
-     * @todo In the future, as long as the number of slices is
-     * identical/consistent between J/K/P, this should handle an
-     * arbitrary number.
+     * For a single trial vector, all cubes will either have 1 slice
+     * (for restricted wavefunctions) or 2 slices (for unrestricted
+     * wavefunctions). When the block solver is used
+     * ("solver_block"), the densities for all trial vectors are
+     * passed at once, so the cubes have nden slices per trial
+     * vector, ordered (alpha, beta) for each vector in turn. The
+     * number of slices is always identical between J/K/P, and
+     * each slice of J/K must only depend on the same slice of P.
      *
      * @param[out] &J generalized Coulomb matrices
      * @param[out] &K generalized exchange matrices
@@ -39,12 +41,28 @@ public:
      * Compute J and K from C_left/L and C_right/R, where the
      * densities P formed from L/R are not necessarily symmetric.
      *
-     * All cubes will either have 1 slice (for restricted
-     * wavefunctions) or 2 slices (for unrestricted wavefunctions).
+     * The number of L/R matrices is identical to the number of
+     * slices in J/K, following the same layout as for P above.
+     *
+     * Each density is given in factored form, \f$ \mathbf{P}^{d} =
+     * \mathbf{L}^{d} (\mathbf{R}^{d})^{T} \f$, where L and R are
+     * [nbasis, rank]. The solvers pass \f$ \mathbf{L} =
+     * \mathbf{C}_{virt} \mathbf{X} \f$ and \f$ \mathbf{R} =
+     * \mathbf{C}_{occ} \f$, so the rank is the number of occupied
+     * orbitals. The results must match compute(J, K, P) for that P,
+     * with
+     *
+     * \f$ J_{\mu\nu} = \sum_{\lambda\sigma} (\mu\nu|\lambda\sigma) P_{\lambda\sigma} \f$
      *
-     * @todo In the future, as long as the number of slices is
-     * identical/consistent between J/K/L/R, this should handle an
-     * arbitrary number.
+     * \f$ K_{\mu\nu} = \sum_{\lambda\sigma} (\mu\lambda|\nu\sigma) P_{\lambda\sigma} = \sum_{k} \sum_{\lambda\sigma} (\mu\lambda|\nu\sigma) L_{\lambda k} R_{\sigma k} \f$
+     *
+     * Engines that can contract the factors directly (for example,
+     * half-transforming 3-index integrals with L and R) should
+     * override this, since K then costs \f$ O(N^{2} o N_{aux}) \f$
+     * instead of the \f$ O(N^{4}) \f$ of a dense build. The default
+     * implementation just forms P and calls compute(J, K, P); see
+     * MatVec_factored for a reference implementation that keeps the
+     * factors separate.
      *
      * @param[out] &J generalized Coulomb matrices
      * @param[out] &K generalized exchange matrices
@@ -53,8 +71,53 @@ public:
      */
     virtual void compute(arma::cube &J, arma::cube &K, const std::vector<arma::mat> &L, const std::vector<arma::mat> &R);
 
+    /*!
+     * Called by the solvers before each compute() with the norm of
+     * every density that is about to be passed, in the same slice
+     * layout as P. With incremental Fock builds ("incremental_fock"),
+     * the densities are changes from the previous iteration and
+     * become small as the solution converges, so engines can use
+     * these to tighten their integral screening. The default
+     * ignores them.
+     *
+     * @param[in] &norms one norm per density
+     */
+    virtual void set_density_norms(const arma::vec &norms);
+
+    /*!
+     * Should the solvers pass densities as L/R factors rather than
+     * as P, when "density_form" is left at "auto"? Engines whose
+     * compute(J, K, L, R) is cheaper than building from P (as for
+     * MatVec_factored) should return true. The default is false.
+     */
+    virtual bool prefers_factored_densities() const;
+
+    /*!
+     * Single-precision versions of compute, used for the early
+     * iterations when "mixed_precision" is on. Same layouts and
+     * results as the double-precision versions, to single precision.
+     *
+     * The default converts to double, calls the double-precision
+     * version, and converts back, so any engine works; engines that
+     * can build J/K in single precision should override these.
+     */
+    virtual void compute(arma::fcube &J, arma::fcube &K, arma::fcube &P);
+    virtual void compute(arma::fcube &J, arma::fcube &K, const std::vector<arma::fmat> &L, const std::vector<arma::fmat> &R);
+
 protected:
 
+    //! Densities formed from L/R by the default implementation,
+    //! kept between calls so they aren't reallocated.
+    arma::cube P_lr;
+
+    //! Double-precision copies for the default single-precision
+    //! implementations.
+    arma::cube J_dp;
+    arma::cube K_dp;
+    arma::cube P_dp;
+    std::vector<arma::mat> L_dp;
+    std::vector<arma::mat> R_dp;
+
 private:
 
 };
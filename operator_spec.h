@@ -7,12 +7,16 @@
  * Hold operators (integrals and metadata) and lists of operators.
  */
 
+#include "checkpoint.h"
 #include "configurable.h"
 #include "indices.h"
 #include "utils.h"
+#include "vector_store.h"
 
 namespace libresponse {
 
+class ediff_nonorthogonal;
+
 /*!
  * Internal representation of operator/integral, metadata only.
  *
@@ -69,6 +73,14 @@ std::ostream& operator<<(std::ostream &stream, const operator_metadata &om);
  * operator. If necessary, the ordering is slices per atom, then
  * Cartesian components x, y, z, xx, xy, xz, yx, yy, ...
  *
+ * The AO integrals are either copied in and owned, or (from a
+ * pointer) used in place from the host's memory. Only the pointer
+ * form avoids duplicating them: copying an operator_spec that owns
+ * its integrals copies them too, unless they have been released.
+ * They are only needed to form the MO-basis property vectors, so the
+ * solvers release them after form_rhs (see release_ao_integrals);
+ * the number of components is kept in ncomp.
+ *
  * The B prefactor is only needed for RPA (not TDA/CIS). If the
  * operator is real, form \f$(\mathbf{A} + \mathbf{B})\f$. If the
  * operator is imaginary, form \f$(\mathbf{A} - \mathbf{B})\f$.
@@ -82,8 +94,9 @@ class operator_spec {
 public:
 
     operator_metadata metadata; //!< operator metadata
-    arma::cube integrals_ao;    //!< AO-basis integrals for operator
+    arma::cube integrals_ao;    //!< AO-basis integrals for operator, if owned
     arma::vec origin;           //!< operator (integral) origin
+    size_t ncomp;               //!< number of components (integral slices)
 
     //! Should this operator be used as a property gradient on the RHS
     //! of the response equations?
@@ -101,14 +114,57 @@ public:
         const arma::cube &C,
         const arma::uvec &occupations,
         const libresponse::configurable &cfg);
+    //! Zero the MO-basis property vectors outside indices_mo_* (for
+    //! "_mask_rhsvec_mo"; form_rhs does this itself).
+    void mask_rhs();
     arma::mat rspvecs_alph;
     arma::mat rspvecs_beta;
     void form_guess_rspvec(const arma::vec &ediff, double frequency, bool beta);
     type::indices indices_ao;
     arma::uvec indices_mo_alph;
     arma::uvec indices_mo_beta;
-    void form_guess_rspvec(const arma::mat &ediff, double frequency, bool beta, size_t nov, const libresponse::configurable &cfg);
+    void form_guess_rspvec(const ediff_nonorthogonal &ediff, double frequency, bool beta, size_t nov, const libresponse::configurable &cfg);
     void save_to_disk(int save_level, bool is_guess);
+    void save_to_checkpoint(checkpoint_writer &chk, bool is_guess) const;
+    void load_from_checkpoint(const checkpoint_reader &chk);
+
+    //! If set (see move_to_store), integrals_mo_ai_* and rspvecs_*
+    //! are empty and the MO-basis vectors live in these stores
+    //! instead: the property vectors in columns [store_col, store_col
+    //! + n_components) and the response vectors, if any, in the
+    //! n_components columns after them.
+    vector_store *store_alph;
+    vector_store *store_beta;
+    size_t store_col;
+
+    /*!
+     * Number of store columns this operator needs per spin.
+     */
+    size_t n_store_cols() const { return (do_response ? 2 : 1) * ncomp; }
+
+    /*!
+     * Move the MO-basis property and response vectors into stores
+     * (n_rows nov_alph and nov_beta) and free the matrices.
+     *
+     * @param[in] *store_alph_ alpha store
+     * @param[in] *store_beta_ beta store, NULL if restricted
+     * @param[in] store_col_ first column to use
+     */
+    void move_to_store(vector_store *store_alph_, vector_store *store_beta_, size_t store_col_);
+
+    /*!
+     * Copy the vectors back into the matrices and forget the stores.
+     */
+    void move_from_store();
+
+    //! Copy one component of the property (RHS) vectors, whether or
+    //! not they are in a store.
+    void get_property_vector(double *v, size_t s, bool beta) const;
+    //! Copy one component of the response vectors.
+    void get_response_vector(double *v, size_t s, bool beta) const;
+    //! Set one component of the response vectors; compress is passed
+    //! on to the store (for converged vectors).
+    void set_response_vector(const double *v, size_t s, bool beta, bool compress = false);
 
 public:
 
@@ -116,7 +172,7 @@ public:
      * Default constructor.
      *
      * @param[in] &operator_metadata_ information about the operator
-     * @param[in] &integrals_ao_ AO-basis integrals for operator
+     * @param[in] &integrals_ao_ AO-basis integrals for operator, copied
      * @param[in] &origin_ operator (integral) origin
      */
     operator_spec(
@@ -127,7 +183,73 @@ public:
         : metadata(metadata_)
         , integrals_ao(integrals_ao_)
         , origin(origin_)
+        , ncomp(integrals_ao_.n_slices)
+        , do_response(do_response_)
+        , store_alph(NULL)
+        , store_beta(NULL)
+        , store_col(0)
+        , integrals_ao_host(NULL)
+        {
+            init_labels();
+        }
+
+    /*!
+     * Use the host's AO integrals in place, without copying them.
+     *
+     * @param[in] &operator_metadata_ information about the operator
+     * @param[in] *integrals_ao_ AO-basis integrals for operator, not
+     *            copied, so they must outlive every use of the AO
+     *            integrals (until form_rhs or release_ao_integrals)
+     * @param[in] &origin_ operator (integral) origin
+     */
+    operator_spec(
+        const operator_metadata &metadata_,
+        const arma::cube *integrals_ao_,
+        const arma::vec &origin_,
+        bool do_response_)
+        : metadata(metadata_)
+        , origin(origin_)
+        , ncomp(integrals_ao_ ? integrals_ao_->n_slices : 0)
         , do_response(do_response_)
+        , store_alph(NULL)
+        , store_beta(NULL)
+        , store_col(0)
+        , integrals_ao_host(integrals_ao_)
+        {
+            if (integrals_ao_ == NULL)
+                throw std::runtime_error("operator_spec: no integrals given");
+            init_labels();
+        }
+
+    /*!
+     * The AO integrals, owned or the host's; empty once released.
+     */
+    const arma::cube &ao_integrals() const { return integrals_ao_host ? *integrals_ao_host : integrals_ao; }
+
+    /*!
+     * Free (or stop referencing) the AO integrals. ncomp and
+     * everything in the MO basis are kept.
+     */
+    void release_ao_integrals() { integrals_ao.reset(); integrals_ao_host = NULL; }
+
+    /*!
+     * Have the AO integrals been released?
+     */
+    bool is_ao_released() const { return ao_integrals().n_slices != ncomp; }
+
+    void init_indices(
+        const arma::umat &fragment_occupations,
+        const libresponse::configurable &cfg);
+
+private:
+
+    const arma::cube *integrals_ao_host;
+
+    //! The property (or response) vectors of one spin: the matrix
+    //! itself, or tmp after copying them out of the store.
+    const arma::mat &stored_vectors(arma::mat &tmp, bool beta, bool response) const;
+
+    void init_labels()
         {
             b_prefactor = is_imaginary_to_b_prefactor(metadata.is_imaginary);
 
@@ -141,12 +263,46 @@ public:
             metadata.origin_label = origin_label.str();
         }
 
-    void init_indices(
-        const arma::umat &fragment_occupations,
-        const libresponse::configurable &cfg);
-
 };
 
+/*!
+ * Save the RHS and response vectors for all operators, along with
+ * the energy differences, to a single binary checkpoint file.
+ *
+ * @param[in] &filename name of the checkpoint file
+ * @param[in] &operators operators to save vectors from
+ * @param[in] &ediff_alph alpha energy differences (vector or matrix)
+ * @param[in] &ediff_beta beta energy differences (empty if restricted)
+ * @param[in] frequency frequency the response vectors are for, recorded as "frequency"
+ * @param[in] is_guess are the response vectors the initial guess?
+ */
+void save_checkpoint(
+    const std::string &filename,
+    const std::vector<operator_spec> &operators,
+    const arma::mat &ediff_alph,
+    const arma::mat &ediff_beta,
+    double frequency,
+    bool is_guess);
+
+/*!
+ * operator_spec::form_rhs for every operator.
+ *
+ * Each operator's components are transformed together by two GEMMs
+ * per spin, so the operators are done one after another, leaving the
+ * threads to the BLAS rather than running many small GEMMs side by
+ * side.
+ *
+ * @param[in,out] &operators operators to form the MO-basis property vectors of
+ * @param[in] &C MO coefficients, 1 slice per alpha/beta spin
+ * @param[in] &occupations 4 elements: nocc_alpha, nvirt_alpha, nocc_beta, nvirt_beta
+ * @param[in] &cfg solver configuration
+ */
+void form_rhs(
+    std::vector<operator_spec> &operators,
+    const arma::cube &C,
+    const arma::uvec &occupations,
+    const libresponse::configurable &cfg);
+
 /*!
  * A shorter way to make a list of labels from a list of operators.
  *
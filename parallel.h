@@ -0,0 +1,78 @@
+#ifndef LIBRESPONSE_PARALLEL_H_
+#define LIBRESPONSE_PARALLEL_H_
+
+/*!
+ * @file
+ *
+ * Optional MPI distribution of independent work (operator components
+ * or frequencies) across ranks.
+ */
+
+#include <cstddef>
+
+#include "libresponse_config.h"
+
+#ifdef LIBRESPONSE_USE_MPI
+#include <mpi.h>
+#endif
+
+namespace libresponse {
+
+/*!
+ * The handful of collective operations the solvers need, so the rest
+ * of the library doesn't depend on MPI.
+ *
+ * Without LIBRESPONSE_USE_MPI (or for a default-constructed object),
+ * this is a single rank and every collective is a no-op, so callers
+ * never need to check whether MPI is available. The macro comes from
+ * the generated libresponse_config.h, so hosts always see the layout
+ * and constructors the library was built with.
+ */
+class communicator {
+
+public:
+
+    //! A single rank.
+    communicator();
+
+#ifdef LIBRESPONSE_USE_MPI
+    /*!
+     * @param[in] comm communicator to distribute over; not
+     *            duplicated, so it must outlive this object
+     */
+    explicit communicator(MPI_Comm comm);
+#endif
+
+    int rank() const { return m_rank; }
+    int size() const { return m_size; }
+    bool is_root() const { return m_rank == 0; }
+
+    /*!
+     * Does this rank own work unit idx under a round-robin split?
+     */
+    bool owns(size_t idx) const { return static_cast<int>(idx % m_size) == m_rank; }
+
+    /*!
+     * Sum n doubles over all ranks in place.
+     */
+    void allreduce_sum(double *data, size_t n) const;
+
+    /*!
+     * Logical OR of a flag over all ranks.
+     */
+    bool allreduce_or(bool flag) const;
+
+private:
+
+#ifdef LIBRESPONSE_USE_MPI
+    MPI_Comm m_comm;
+    bool m_has_comm;
+#endif
+    int m_rank;
+    int m_size;
+
+};
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_PARALLEL_H_
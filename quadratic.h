@@ -0,0 +1,12 @@
+#ifndef LIBRESPONSE_QUADRATIC_H_
+#define LIBRESPONSE_QUADRATIC_H_
+
+/*!
+ * @file
+ *
+ * Collect all headers for quadratic response as external interface.
+ */
+
+#include "quadratic/interface.h"
+
+#endif // LIBRESPONSE_QUADRATIC_H_
@@ -0,0 +1,168 @@
+#ifndef LIBRESPONSE_QUADRATIC_HELPERS_H_
+#define LIBRESPONSE_QUADRATIC_HELPERS_H_
+
+/*!
+ * @file
+ *
+ * Core routines for quadratic response from first-order vectors.
+ *
+ * Everything here is in the spin-orbital TDHF picture: for a real
+ * perturbation \f$ \hat{V}^{x} \f$ at frequency \f$ \omega_x \f$, the
+ * first-order MO density of one spin only has the virt-occ block
+ * \f$ \mathbf{X}^{x} \f$ and the occ-virt block \f$
+ * (\mathbf{Y}^{x})^{T} \f$, both stored as [nvirt, nocc] with 'a'
+ * fast, like the linear solver's packed vectors. With
+ * \f$ \tilde{\mathbf{V}}^{x} = \mathbf{V}^{x} + \mathbf{G}[\mathbf{D}^{x}] \f$,
+ * the 2n+1 rule gives
+ *
+ * \f$ \left\langle\left\langle \hat{A};\hat{B},\hat{C} \right\rangle\right\rangle_{\omega_b,\omega_c} =
+ *     \mathrm{Tr}[\tilde{\mathbf{V}}^{a} \mathbf{D}^{bc}_{\mathrm{d}}]
+ *   - \mathrm{Tr}[[\mathbf{D}^{a},\mathbf{D}_{0}]([\tilde{\mathbf{V}}^{b},\mathbf{D}^{c}] + [\tilde{\mathbf{V}}^{c},\mathbf{D}^{b}])] \f$
+ *
+ * where \f$ \mathbf{D}^{a} \f$ is the first-order density for \f$
+ * \hat{A} \f$ at \f$ -\omega_\sigma = -(\omega_b + \omega_c) \f$ and
+ * \f$ \mathbf{D}^{bc}_{\mathrm{d}} \f$ the occ-occ and virt-virt
+ * blocks of the second-order density, which follow from idempotency.
+ * Only the occ-occ and virt-virt blocks of each \f$
+ * \tilde{\mathbf{V}}^{x} \f$ enter, so no second-order equations are
+ * solved.
+ */
+
+#include <armadillo>
+#include <string>
+#include <vector>
+#include "../operator_spec.h"
+
+namespace libresponse {
+
+/*!
+ * Converged first-order response vectors for every operator
+ * component at a set of frequencies, as left in the operators by
+ * solve_linear_response.
+ */
+class first_order_vectors {
+
+public:
+
+    std::vector<double> frequencies;
+    std::vector<arma::mat> vecs_alph; //!< [nov_alph, n_components] per frequency
+    std::vector<arma::mat> vecs_beta; //!< [nov_beta, n_components] per frequency, empty if restricted
+
+    /*!
+     * @returns index of the frequency, or frequencies.size() if it isn't there
+     */
+    size_t find(double frequency) const;
+
+    /*!
+     * Copy the response vectors currently held by the operators (in
+     * their matrices or a store) as those for this frequency.
+     */
+    void add(double frequency, const std::vector<operator_spec> &operators);
+
+    /*!
+     * Take these as the vectors for this frequency, replacing any
+     * already there.
+     */
+    void add(double frequency, const arma::mat &alph, const arma::mat &beta);
+
+    /*!
+     * Write (or read) every frequency to a binary checkpoint.
+     */
+    void save(const std::string &filename) const;
+    void load(const std::string &filename);
+
+    /*!
+     * Add the response vectors in a binary checkpoint written by
+     * solve_linear_response (<prefix>response.chk), as those for the
+     * frequency recorded in it.
+     */
+    void load_linear(const std::string &filename, const std::vector<operator_spec> &operators);
+
+};
+
+/*!
+ * One spin of the first-order density of one operator component at
+ * one frequency, along with the occ-occ and virt-virt MO blocks of
+ * the perturbation dressed with its Fock build.
+ */
+struct first_order_block {
+
+    arma::mat X;    //!< virt-occ block, [nvirt, nocc]
+    arma::mat Y;    //!< occ-virt block, transposed, [nvirt, nocc]
+    arma::mat V_oo; //!< occ-occ block of \f$ \mathbf{V} + \mathbf{G}[\mathbf{D}] \f$
+    arma::mat V_vv; //!< virt-virt block of \f$ \mathbf{V} + \mathbf{G}[\mathbf{D}] \f$
+
+    /*!
+     * The same block at the opposite frequency: for a real
+     * perturbation \f$ \mathbf{D}(-\omega) = \mathbf{D}(\omega)^{T} \f$,
+     * so X and Y swap and the dressed blocks are transposed, with no
+     * additional Fock build.
+     */
+    first_order_block transposed() const;
+
+};
+
+/*!
+ * Form the AO-basis first-order density of one spin, \f$
+ * \mathbf{P} = \mathbf{C}_{virt} \mathbf{X} \mathbf{C}_{occ}^{T} +
+ * \mathbf{C}_{occ} \mathbf{Y}^{T} \mathbf{C}_{virt}^{T} \f$.
+ *
+ * @param[out] &P AO-basis density, [nbasis, nbasis]
+ * @param[in] &X virt-occ block, [nvirt, nocc]
+ * @param[in] &Y occ-virt block, transposed, [nvirt, nocc]
+ * @param[in] &C_occ occupied MO coefficients (1 spin)
+ * @param[in] &C_virt virtual MO coefficients (1 spin)
+ */
+void form_first_order_density(
+    arma::mat &P,
+    const arma::mat &X,
+    const arma::mat &Y,
+    const arma::mat &C_occ,
+    const arma::mat &C_virt
+    );
+
+/*!
+ * Transform \f$ \mathbf{V} + \mathbf{G} \f$ to its occ-occ and
+ * virt-virt MO blocks.
+ *
+ * @param[out] &block V_oo and V_vv are set
+ * @param[in] &V_ao AO-basis perturbation
+ * @param[in] &G_ao AO-basis two-electron part for this spin, from the first-order density
+ * @param[in] &C_occ occupied MO coefficients (1 spin)
+ * @param[in] &C_virt virtual MO coefficients (1 spin)
+ */
+void form_dressed_blocks(
+    first_order_block &block,
+    const arma::mat &V_ao,
+    const arma::mat &G_ao,
+    const arma::mat &C_occ,
+    const arma::mat &C_virt
+    );
+
+/*!
+ * Add one spin's contribution to \f$
+ * \left\langle\left\langle \hat{A};\hat{B},\hat{C} \right\rangle\right\rangle_{\omega_b,\omega_c} \f$
+ * for every combination of components.
+ *
+ * The products of each dressed perturbation with each density are
+ * formed once per pair of components, so the cost is \f$ O(n^{2}
+ * v^{2} o) \f$ in GEMMs plus \f$ O(n^{3} o v) \f$ in dot products
+ * for n components.
+ *
+ * @param[in,out] &results [n_a, n_b, n_c]
+ * @param[in] &a blocks at \f$ -\omega_\sigma \f$
+ * @param[in] &b blocks at \f$ \omega_b \f$
+ * @param[in] &c blocks at \f$ \omega_c \f$
+ * @param[in] weight factor for this spin (2 for a restricted reference)
+ */
+void accumulate_quadratic_response(
+    arma::cube &results,
+    const std::vector<first_order_block> &a,
+    const std::vector<first_order_block> &b,
+    const std::vector<first_order_block> &c,
+    double weight
+    );
+
+}
+
+#endif // LIBRESPONSE_QUADRATIC_HELPERS_H_
@@ -0,0 +1,87 @@
+#ifndef LIBRESPONSE_QUADRATIC_INTERFACE_H_
+#define LIBRESPONSE_QUADRATIC_INTERFACE_H_
+
+/*!
+ * @file
+ *
+ * Function interfaces to quadratic response.
+ */
+
+#include <armadillo>
+#include <utility>
+#include <vector>
+#include "../configurable.h"
+#include "../matvec_i.h"
+#include "../operator_spec.h"
+#include "../timings.h"
+#include "../linear/iterator.h"
+#include "helpers.h"
+
+namespace libresponse {
+
+//! The two perturbing frequencies \f$ (\omega_1, \omega_2) \f$.
+typedef std::pair<double, double> frequency_pair;
+
+/*!
+ * Compute \f$ -\left\langle\left\langle \hat{A};\hat{B},\hat{C} \right\rangle\right\rangle_{0,0} \f$
+ * (for dipole operators, the static \f$ \beta(0;0,0) \f$) from
+ * first-order response vectors only, using the 2n+1 rule.
+ *
+ * Only static fields are supported: every frequency pair must be
+ * (0, 0), and anything else throws. The linear solver solves \f$
+ * (\mathbf{A} + \mathbf{B} - \omega)\mathbf{x} = -\mathbf{V} \f$
+ * rather than the coupled pair \f$ (\mathbf{A} - \omega)\mathbf{X}
+ * + \mathbf{B}\mathbf{Y} = -\mathbf{V} \f$, \f$ \mathbf{B}\mathbf{X}
+ * + (\mathbf{A} + \omega)\mathbf{Y} = -\mathbf{V} \f$, and the two
+ * only agree (with \f$ \mathbf{X} = \mathbf{Y} \f$) at \f$ \omega
+ * = 0 \f$. The expressions below are written for the general case,
+ * with the virt-occ block of each first-order density taken from the
+ * vector at \f$ \omega \f$ and the occ-virt block from the one at
+ * \f$ -\omega \f$.
+ *
+ * The first-order vectors are taken, in this order, from *vectors,
+ * from <prefix>quadratic_first_order.chk if "quadratic_read" is set,
+ * or from a linear job's <prefix>response.chk if
+ * "quadratic_read_linear" is set; the rest are solved for in a single
+ * solve_linear_response call. With save > 0 and any solved for, all
+ * of them are written to <prefix>quadratic_first_order.chk. After
+ * that, the Fock builds of every first-order density (one per
+ * component) go through matvec in a single call, and the rest is
+ * dense algebra in the occ-occ and virt-virt MO blocks; no
+ * second-order equations are solved.
+ *
+ * Only real, spin-independent operators with an RPA singlet
+ * Hessian and an orthogonal reference are supported. Every operator
+ * is both perturbation and property, so all need do_response, and
+ * their AO integrals are needed until the end (they are released
+ * afterwards unless "keep_ao_integrals" is set).
+ *
+ * @param[out] &results one cube per frequency pair, [n_components, n_components, n_components], indexed (A, B, C) with A the property and B and C the perturbations
+ * @param[in] *matvec Two-electron integral computation object.
+ * @param[in,out] *solver_iterator iterator for the linear stage, or NULL for one owned by each linear solve
+ * @param[in] &C MO coeffcients, 1 slice per alpha/beta spin
+ * @param[in] &moene energies of all MOs, 1 column per alpha/beta spin
+ * @param[in] &occupations 4 elements: nocc_alpha, nvirt_alpha, nocc_beta, nvirt_beta
+ * @param[in] &frequencies one or more pairs \f$ (\omega_1, \omega_2) \f$, each (0, 0)
+ * @param[in] &operators one or more operators
+ * @param[in] &cfg Map to hold configuration for solver
+ * @param[in,out] *timings optional per-phase timings and iteration counts to accumulate into
+ * @param[in,out] *vectors optional first-order vectors already at hand (for example, filled from a linear stage through a response_vector_sink), which every other one found or solved for is added to
+ */
+void solve_quadratic_response(
+    std::vector<arma::cube> &results,
+    MatVec_i *matvec,
+    SolverIterator_i<arma::vec> *solver_iterator,
+    const arma::cube &C,
+    const arma::mat &moene,
+    const arma::uvec &occupations,
+    const std::vector<frequency_pair> &frequencies,
+    std::vector<operator_spec> &operators,
+    const configurable &cfg,
+    timing_summary *timings = NULL,
+    first_order_vectors *vectors = NULL
+    );
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_QUADRATIC_INTERFACE_H_
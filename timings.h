@@ -0,0 +1,132 @@
+#ifndef LIBRESPONSE_TIMINGS_H_
+#define LIBRESPONSE_TIMINGS_H_
+
+/*!
+ * @file
+ *
+ * Per-phase timing and iteration counters.
+ */
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace libresponse {
+
+//! The phases of a response calculation that are timed separately.
+enum timing_phase {
+    PHASE_JK,            //!< MatVec_i::compute (Fock builds)
+    PHASE_DENSITY,       //!< compute_generalized_density or L/R factors
+    PHASE_HESSIAN,       //!< form_orbital_hessian_equations/products
+    PHASE_AO2MO,         //!< AO2MO of the Hessian-vector products
+    PHASE_NEW_RSPVEC,    //!< form_new_rspvec and solver updates
+    PHASE_MASKING,       //!< ALMO masking
+    PHASE_FORM_RHS,      //!< operator_spec::form_rhs
+    PHASE_FORM_RESULTS,  //!< form_results
+    PHASE_IO,            //!< reading and writing vectors and checkpoints
+    N_TIMING_PHASES
+};
+
+//! Short name of a phase, as used in the JSON output.
+const char *timing_phase_name(timing_phase phase);
+
+//! Accumulated time for one phase.
+struct phase_timing {
+    double wall; //!< wall time in seconds
+    double cpu;  //!< process CPU time in seconds (all threads)
+    size_t calls;
+};
+
+//! Iterations taken by one operator component at one frequency.
+struct iteration_record {
+    size_t frequency_index;
+    size_t operator_index;
+    size_t component;
+    size_t iterations;
+    bool converged;
+};
+
+/*!
+ * Timings and counters for one call to solve_linear_response.
+ *
+ * Pass a pointer to one of these to solve_linear_response to get it
+ * back; it is accumulated into, so reset() it between calls if
+ * needed. Timing is only done outside of OpenMP parallel regions,
+ * except for the two threads of the async pipeline, whose phases
+ * overlap, so their times can add up to more than the total.
+ */
+struct timing_summary {
+
+    phase_timing phases[N_TIMING_PHASES];
+    std::vector<iteration_record> iterations;
+    double total_wall;
+    double total_cpu;
+
+    timing_summary() { reset(); }
+
+    void reset();
+
+    void add(timing_phase phase, double wall, double cpu);
+
+    /*!
+     * Add the phases and iterations of another summary, such as one
+     * kept by a concurrent solve. The totals are left alone, since
+     * concurrent solves overlap.
+     */
+    void merge(const timing_summary &other);
+
+    /*!
+     * Total number of iterations over all components at a frequency.
+     */
+    size_t iterations_for_frequency(size_t frequency_index) const;
+
+    /*!
+     * Human-readable table.
+     */
+    void print(std::ostream &os) const;
+
+    /*!
+     * The whole summary as a JSON object.
+     */
+    std::string to_json() const;
+
+    /*!
+     * Write to_json() to a file.
+     */
+    void save_json(const std::string &filename) const;
+
+};
+
+/*!
+ * Time a scope and add it to a phase of a summary when it ends (or
+ * at stop()). A NULL summary makes this a no-op, so call sites don't
+ * need to check whether timing was requested.
+ */
+class scoped_timer {
+
+public:
+    scoped_timer(timing_summary *summary, timing_phase phase);
+    ~scoped_timer() { stop(); }
+
+    void stop();
+
+private:
+    timing_summary *m_summary;
+    timing_phase m_phase;
+    double m_wall_start;
+    double m_cpu_start;
+
+    scoped_timer(const scoped_timer &);
+    scoped_timer &operator=(const scoped_timer &);
+
+};
+
+//! Seconds since the epoch.
+double wall_time();
+
+//! Process CPU time in seconds.
+double cpu_time();
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_TIMINGS_H_
@@ -313,6 +313,55 @@ T join(const T &a1, const T &a2)
 
 }
 
+/*!
+ * Set the calling thread's number of OpenMP threads for the lifetime
+ * of this object, then restore the caller's setting, so the host
+ * program's threading isn't changed behind its back. Every parallel
+ * region opened meanwhile from this thread gets it, including those
+ * inside a J/K engine.
+ *
+ * Without OpenMP, or for num_threads <= 0 (use the OpenMP default),
+ * this does nothing.
+ */
+class scoped_num_threads {
+
+public:
+    scoped_num_threads(int num_threads);
+    ~scoped_num_threads();
+
+private:
+    int m_previous;
+
+    scoped_num_threads(const scoped_num_threads &);
+    scoped_num_threads &operator=(const scoped_num_threads &);
+
+};
+
+/*!
+ * Allow at least this many nested active parallel levels for the
+ * lifetime of this object, then restore the caller's setting, so a
+ * parallel region opened inside another (such as a threaded J/K
+ * engine inside the async pipeline's sections) still gets its
+ * threads.
+ *
+ * Without OpenMP, for levels <= 0, or when already inside a parallel
+ * region (where changing it is implementation-defined), this does
+ * nothing.
+ */
+class scoped_max_active_levels {
+
+public:
+    scoped_max_active_levels(int levels);
+    ~scoped_max_active_levels();
+
+private:
+    int m_previous;
+
+    scoped_max_active_levels(const scoped_max_active_levels &);
+    scoped_max_active_levels &operator=(const scoped_max_active_levels &);
+
+};
+
 void print_polarizability(std::ostringstream &os, const arma::mat &polar_tensor);
 
 void print_square_result(std::ostringstream &os, const arma::mat &square_result);
@@ -0,0 +1,103 @@
+#ifndef LIBRESPONSE_VECTOR_STORE_H_
+#define LIBRESPONSE_VECTOR_STORE_H_
+
+/*!
+ * @file
+ *
+ * Column storage for property and response vectors outside of the
+ * operators, either on the heap or spilled to a memory-mapped file.
+ */
+
+#include <armadillo>
+#include <string>
+#include <vector>
+
+namespace libresponse {
+
+/*!
+ * A fixed number of vectors (columns) of the same length, copied in
+ * and out one at a time.
+ *
+ * With a filename, the columns live in a shared memory mapping of a
+ * scratch file, so the kernel only keeps the pages of recently used
+ * columns resident and writes the rest back to disk. The file name is
+ * made unique (mkstemp), and the file is unlinked as soon as it is
+ * mapped, so nothing is left behind even if the process dies. Without
+ * a filename, each column is its own heap allocation.
+ *
+ * Columns stored with compress = true (by a store that allows it) are
+ * kept in single precision, which halves their memory (or resident
+ * pages) at a relative error of about 1e-7. get() always returns
+ * double precision.
+ *
+ * Different columns can be accessed from different threads at once.
+ */
+class vector_store {
+
+public:
+
+    /*!
+     * @param[in] n_rows length of each vector
+     * @param[in] n_cols number of vectors
+     * @param[in] &filename start of the scratch file name (a unique
+     *            suffix is added), or empty to keep everything on the
+     *            heap
+     * @param[in] allow_compress store columns put() with compress = true in single precision
+     */
+    vector_store(size_t n_rows, size_t n_cols, const std::string &filename = "", bool allow_compress = false);
+    ~vector_store();
+
+    size_t n_rows() const { return m_n_rows; }
+    size_t n_cols() const { return m_n_cols; }
+    bool is_mapped() const { return m_map != NULL; }
+
+    /*!
+     * Store n_rows doubles as column col.
+     *
+     * @param[in] col column index
+     * @param[in] *v data to copy
+     * @param[in] compress keep it in single precision, if allowed
+     */
+    void put(size_t col, const double *v, bool compress = false);
+
+    /*!
+     * Copy column col into n_rows doubles.
+     */
+    void get(size_t col, double *v) const;
+
+    bool is_compressed(size_t col) const { return m_compressed.at(col) != 0; }
+
+    /*!
+     * Bytes of column storage currently allocated on the heap (zero
+     * for a mapped store, whose pages belong to the kernel).
+     */
+    size_t heap_bytes() const;
+
+private:
+
+    size_t m_n_rows;
+    size_t m_n_cols;
+    bool m_allow_compress;
+
+    //! Mapped backend: one slot of n_rows doubles per column; a
+    //! compressed column only uses the first half of its slot.
+    void *m_map;
+    size_t m_size;
+
+    //! Heap backend: exactly one of these is allocated per column.
+    std::vector<arma::vec> m_cols;
+    std::vector<arma::fvec> m_cols_f;
+
+    std::vector<char> m_compressed;
+
+    char *slot(size_t col) const;
+
+    // The mapping can't be shared between copies.
+    vector_store(const vector_store &);
+    vector_store &operator=(const vector_store &);
+
+};
+
+} // namespace libresponse
+
+#endif // LIBRESPONSE_VECTOR_STORE_H_